@@ -3,7 +3,10 @@
 //
 #pragma once
 #include <sqlite3.h>
+#include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
 
 namespace db
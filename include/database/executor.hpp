@@ -0,0 +1,30 @@
+#pragma once
+#include <database/db.hpp>
+#include <server/event_loop.hpp>
+#include <server/thread_pool.hpp>
+
+
+namespace db
+{
+    //* Owns a Database and serializes every call on its own thread.
+    //* Coroutine handlers await the result instead of blocking the event loop:
+    /*
+        auto rows = co_await executor.run([](db::Database& d) { return d.select("SELECT * FROM users"); });
+     */
+    class Executor
+    {
+        private:
+            Database db_;
+            //? declared after db_ so the thread is joined before the connection closes
+            server::ThreadPool pool_{1, "DatabaseThread"};
+
+        public:
+            explicit Executor(const std::string& dbPath) : db_(dbPath) {}
+
+            template <typename F>
+            auto run(F fn)
+            {
+                return coro::offload(pool_, [this, fn = std::move(fn)]() mutable { return fn(db_); });
+            }
+    };
+}//namespace db
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+
+namespace server
+{
+//* Records incoming traffic so it can be replayed later with tests/replay.py.
+//*
+//* File layout (little endian): the 8 byte magic "HTCAP01\n", then one record per event
+//*   u8  kind        0 = connection opened, 1 = bytes received, 2 = connection closed,
+//*                   3 = connection truncated, records of it were lost and the rest of it isn't recorded
+//*   u64 time        nanoseconds since the capture started
+//*   u64 connection  id, unique for the lifetime of the server
+//*   u16 port        listener that accepted the connection
+//*   u32 length      payload size, 0 for open/close
+//*   payload         raw bytes exactly as recv() returned them, so pipelining survives the replay
+//*
+//* Loop threads only append to an in-memory batch under a short lock, a background thread does the
+//* file writes. When the writer can't keep up, records are dropped instead of stalling the loops. A connection
+//* that loses a record is marked truncated so the replay skips it rather than sending a broken byte stream.
+class TrafficCapture
+{
+public:
+    enum class Kind : std::uint8_t { Open = 0, Data, Close, Truncated };
+
+    explicit TrafficCapture(const std::string& path, std::size_t maxPendingBytes = 64 * 1024 * 1024);
+    ~TrafficCapture();
+
+    TrafficCapture(const TrafficCapture&) = delete;
+    TrafficCapture& operator=(const TrafficCapture&) = delete;
+    TrafficCapture(TrafficCapture&&) = delete;
+    TrafficCapture& operator=(TrafficCapture&&) = delete;
+
+    void opened(std::uint64_t connection, std::uint16_t port) { record(Kind::Open, connection, port, {}); }
+    void received(std::uint64_t connection, std::uint16_t port, std::string_view bytes) { record(Kind::Data, connection, port, bytes); }
+    void closed(std::uint64_t connection, std::uint16_t port) { record(Kind::Close, connection, port, {}); }
+
+    std::uint64_t dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+    std::uint64_t truncatedConnections() const noexcept { return truncatedConnections_.load(std::memory_order_relaxed); }
+
+    static constexpr std::string_view magic{"HTCAP01\n"};
+    static constexpr std::size_t recordHeaderSize = 1 + 8 + 8 + 2 + 4;
+
+private:
+    void record(Kind kind, std::uint64_t connection, std::uint16_t port, std::string_view bytes);
+    void append(Kind kind, std::uint64_t connection, std::uint16_t port, std::string_view bytes);
+    void writerLoop();
+
+    std::FILE* file_;
+    const std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+    const std::size_t maxPendingBytes_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::string pending_;
+    bool stop_ = false;
+    std::unordered_set<std::uint64_t> truncated_;  //? connections that lost a record and are still open
+    std::atomic<std::uint64_t> dropped_{0};
+    std::atomic<std::uint64_t> truncatedConnections_{0};
+
+    std::thread writer_;
+};
+}  // namespace server
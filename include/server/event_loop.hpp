@@ -0,0 +1,217 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <server/task.hpp>
+#include <server/thread_pool.hpp>
+#include <sys/types.h>
+
+namespace server
+{
+//* Single threaded epoll loop that drives coroutines.
+//* Every socket wait, timer and finished offload job ends up as a coroutine_handle resumed here,
+//* so one thread can keep thousands of slow connections in flight.
+class EventLoop
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit EventLoop(ThreadPool& workers);
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+    EventLoop(EventLoop&&) = delete;
+    EventLoop& operator=(EventLoop&&) = delete;
+
+    void run();
+    //* thread safe. Also works before run(), which then returns right away. A stopped loop doesn't restart
+    void stop();
+    //* thread safe, the task starts on the loop thread and frees itself when it finishes
+    void spawn(coro::Task<> task);
+    //* thread safe, resumes the handle on the loop thread
+    void post(std::coroutine_handle<> handle);
+    //* Drops pending waiters for the fd and closes it
+    void close(int fd);
+
+    ThreadPool& workers() const noexcept { return workers_; }
+    //* Loop running on the calling thread, throws when called outside of run()
+    static EventLoop& current();
+
+    struct IoAwaiter
+    {
+        EventLoop& loop;
+        int fd;
+        bool write;
+        Clock::time_point deadline = Clock::time_point::max();
+
+        static bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { loop.addWaiter(fd, write, handle, deadline); }
+        static void await_resume() noexcept {}
+    };
+
+    struct TimerAwaiter
+    {
+        EventLoop& loop;
+        Clock::time_point deadline;
+
+        bool await_ready() const noexcept { return deadline <= Clock::now(); }
+        void await_suspend(std::coroutine_handle<> handle) { loop.addTimer(deadline, handle); }
+        static void await_resume() noexcept {}
+    };
+
+    IoAwaiter readable(const int fd) noexcept { return {*this, fd, false}; }
+    //* Also resumes once the deadline passed, the caller finds out because the fd still isn't readable
+    IoAwaiter readable(const int fd, const Clock::time_point deadline) noexcept { return {*this, fd, false, deadline}; }
+    IoAwaiter writable(const int fd) noexcept { return {*this, fd, true}; }
+    TimerAwaiter sleepUntil(const Clock::time_point deadline) noexcept { return {*this, deadline}; }
+
+private:
+    struct IoWaiters
+    {
+        std::coroutine_handle<> reader;
+        std::coroutine_handle<> writer;
+        std::uint64_t readTicket = 0;  //? tells a read deadline whether the read it belongs to is still waiting
+        bool registered = false;
+    };
+
+    struct Timer
+    {
+        Clock::time_point deadline;
+        std::uint64_t seq;
+        std::coroutine_handle<> handle;
+        int fd = -1;                 //? read deadlines only, the read may have finished before it fired
+        std::uint64_t readTicket = 0;
+
+        bool operator>(const Timer& other) const noexcept
+        {
+            return deadline != other.deadline ? deadline > other.deadline : seq > other.seq;
+        }
+    };
+
+    void addWaiter(int fd, bool write, std::coroutine_handle<> handle, Clock::time_point deadline);
+    void addTimer(Clock::time_point deadline, std::coroutine_handle<> handle);
+    void arm(int fd);
+    void dispatchIo(int fd, std::uint32_t events);
+    void fireTimers();
+    void drainPosted();
+    int nextTimeoutMs() const;
+
+    int epollFd_;
+    int wakeFd_;
+    ThreadPool& workers_;
+
+    //* indexed by fd, they are small and dense so no hashing needed
+    std::vector<IoWaiters> waiters_;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<>> timers_;
+    std::uint64_t timerSeq_ = 0;
+    std::uint64_t readTicket_ = 0;
+
+    std::mutex postedMutex_;
+    std::vector<std::coroutine_handle<>> posted_;
+    std::vector<std::coroutine_handle<>> draining_;
+    bool wakePending_ = false;
+
+    //* only ever cleared, so a stop() that races with the start of run() isn't lost
+    std::atomic<bool> running_{true};
+};
+}  // namespace server
+
+namespace coro
+{
+//* Runs fn on a thread pool and resumes the awaiting coroutine back on its loop with the result.
+template <typename F>
+class OffloadAwaiter
+{
+    using Result = std::invoke_result_t<F&>;
+    struct Empty
+    {
+    };
+    using Stored = std::conditional_t<std::is_void_v<Result>, Empty, Result>;
+
+public:
+    OffloadAwaiter(server::ThreadPool& pool, F fn) : pool_(pool), fn_(std::move(fn)) {}
+
+    static bool await_ready() noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        server::EventLoop& loop = server::EventLoop::current();
+        pool_.submit([this, handle, &loop] {
+            try
+            {
+                if constexpr (std::is_void_v<Result>)
+                {
+                    fn_();
+                    result_.emplace();
+                }
+                else
+                {
+                    result_.emplace(fn_());
+                }
+            }
+            catch (...)
+            {
+                exception_ = std::current_exception();
+            }
+            loop.post(handle);
+        });
+    }
+
+    Result await_resume()
+    {
+        if (exception_)
+        {
+            std::rethrow_exception(exception_);
+        }
+        if constexpr (!std::is_void_v<Result>)
+        {
+            return std::move(*result_);
+        }
+    }
+
+private:
+    server::ThreadPool& pool_;
+    F fn_;
+    std::optional<Stored> result_;
+    std::exception_ptr exception_;
+};
+
+template <typename F>
+OffloadAwaiter<F> offload(server::ThreadPool& pool, F fn)
+{
+    return OffloadAwaiter<F>(pool, std::move(fn));
+}
+
+//* Offloads to the worker pool of the current loop
+template <typename F>
+OffloadAwaiter<F> offload(F fn)
+{
+    return OffloadAwaiter<F>(server::EventLoop::current().workers(), std::move(fn));
+}
+
+inline server::EventLoop::TimerAwaiter sleepFor(const server::EventLoop::Clock::duration duration)
+{
+    return server::EventLoop::current().sleepUntil(server::EventLoop::Clock::now() + duration);
+}
+
+//* Socket helpers for non-blocking fds, they suspend on the loop instead of blocking the thread.
+//* recvSome returns what recv(2) returned, 0 on orderly shutdown and -1 on error.
+//* When nothing arrived before the deadline it returns -1 with errno set to ETIMEDOUT
+Task<ssize_t> recvSome(int fd, std::span<char> buffer,
+                       server::EventLoop::Clock::time_point deadline = server::EventLoop::Clock::time_point::max());
+//* false when the peer went away before everything was written
+Task<bool> sendAll(int fd, std::string_view data);
+//* Gathered write (head + body in one sendmsg), so the body never gets copied behind the head
+Task<bool> sendAll(int fd, std::string_view head, std::string_view body);
+}  // namespace coro
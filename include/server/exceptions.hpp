@@ -43,6 +43,18 @@ namespace exceptions
     using CustomException::CustomException;
   };
 
+  class EventLoopException final : public CustomException
+  {
+  public:
+    using CustomException::CustomException;
+  };
+
+  class CaptureException final : public CustomException
+  {
+  public:
+    using CustomException::CustomException;
+  };
+
   class HandlerException final : public CustomException
   {
   public:
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//* HPACK (RFC 7541) header compression for the HTTP/2 connections
+namespace hpack
+{
+struct HeaderField
+{
+    std::string name;
+    std::string value;
+};
+
+//* Canonical Huffman code from RFC 7541 appendix B. Decoding fails on EOS or bad padding
+bool huffmanDecode(std::span<const std::uint8_t> in, std::string& out);
+void huffmanEncode(std::string_view in, std::string& out);
+std::size_t huffmanLength(std::string_view in) noexcept;
+
+//* Entries cost name + value + 32 bytes, the oldest ones are evicted once maxSize is exceeded
+class DynamicTable
+{
+public:
+    explicit DynamicTable(const std::size_t maxSize = 4096) : maxSize_(maxSize) {}
+
+    void add(std::string_view name, std::string_view value);
+    void resize(std::size_t maxSize);
+
+    //* 0 is the newest entry
+    const HeaderField& at(const std::size_t index) const { return entries_[index]; }
+    std::size_t count() const noexcept { return entries_.size(); }
+    std::size_t maxSize() const noexcept { return maxSize_; }
+
+    static constexpr std::size_t entryOverhead = 32;
+
+private:
+    void evict(std::size_t needed);
+
+    std::deque<HeaderField> entries_;
+    std::size_t size_ = 0;
+    std::size_t maxSize_;
+};
+
+class Decoder
+{
+public:
+    //* limit is the SETTINGS_HEADER_TABLE_SIZE we advertised, the peer can only resize the table below it.
+    //* maxListSize caps the decoded bytes of one block so a small block can't expand into a huge one
+    explicit Decoder(std::size_t limit = 4096, std::size_t maxListSize = 64 * 1024);
+
+    //* Appends the block's fields to out. false means a COMPRESSION_ERROR, the table can't be trusted afterwards
+    bool decode(std::span<const std::uint8_t> block, std::vector<HeaderField>& out);
+
+private:
+    const HeaderField* lookup(std::uint64_t index) const;
+
+    DynamicTable table_;
+    std::size_t limit_;
+    std::size_t maxListSize_;
+};
+
+class Encoder
+{
+public:
+    //* Peer's SETTINGS_HEADER_TABLE_SIZE, the change is announced at the start of the next block
+    void setMaxTableSize(std::size_t size);
+
+    //* Appends one field to out, name has to be lowercase.
+    //* Values that change on every response (content-length, set-cookie, date) are not added to the table
+    void encode(std::string& out, std::string_view name, std::string_view value);
+
+private:
+    DynamicTable table_;
+    std::size_t pendingSize_ = 0;
+    bool sizeUpdatePending_ = false;
+};
+}  // namespace hpack
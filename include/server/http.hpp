@@ -0,0 +1,149 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace http
+{
+//* Headers the server itself looks at (and handlers usually ask for) get a fixed slot,
+//* so header(Header::Host) is an array index instead of a search.
+enum class Header : std::uint8_t
+{
+    Host = 0,
+    Connection,
+    ContentLength,
+    ContentType,
+    Cookie,
+    Upgrade,
+    Accept,
+    AcceptEncoding,
+    Authorization,
+    UserAgent,
+    TransferEncoding,
+    Count
+};
+
+//* FNV-1a over the ASCII-lowercased name. constexpr so the common header hashes are computed at compile time
+constexpr std::uint64_t hashName(const std::string_view name) noexcept
+{
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (const char c : name)
+    {
+        const char lower = (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+        hash = (hash ^ static_cast<unsigned char>(lower)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+using Params = std::vector<std::pair<std::string_view, std::string_view>>;
+
+//* Read-only view of one request. Everything points into the connection buffer, so a Request is only
+//* valid while its handler runs. Query string and cookies are split on first use only.
+class Request
+{
+public:
+    struct Field
+    {
+        std::string_view name;  //? lowercase, the parser folds names in place
+        std::string_view value;
+        std::uint64_t hash;
+    };
+
+    //* Parses the request line and headers in head, which ends with the CRLF of the last header.
+    //* Header names are lowercased in place. Returns false on a malformed head
+    bool parse(std::span<char> head);
+    //* The connection buffer moved (it grew while reading the body), move the views with it
+    void rebase(const char* oldBase, const char* newBase) noexcept;
+    void reset() noexcept;
+    //* For requests that don't come as an HTTP/1 head (HTTP/2 streams). The views have to outlive the request
+    void setHead(std::string_view method, std::string_view target, std::string_view version);
+    //* name has to be lowercase already
+    void addHeader(std::string_view name, std::string_view value);
+
+    std::string_view method() const noexcept { return method_; }
+    //* Path without the query string
+    std::string_view path() const noexcept { return path_; }
+    //* Raw query string without the '?', not percent-decoded
+    std::string_view rawQuery() const noexcept { return query_; }
+    std::string_view target() const noexcept { return target_; }
+    std::string_view version() const noexcept { return version_; }
+    std::string_view body() const noexcept { return body_; }
+    std::string_view clientAddress() const noexcept { return clientAddress_; }
+
+    void setBody(const std::string_view body) noexcept { body_ = body; }
+    void setClientAddress(const std::string_view address) noexcept { clientAddress_ = address; }
+
+    //* Empty view when the header is missing
+    std::string_view header(Header header) const noexcept { return common_[static_cast<std::size_t>(header)]; }
+    //* Case-insensitive lookup for any header
+    std::string_view header(std::string_view name) const noexcept;
+    std::span<const Field> headers() const noexcept { return fields_; }
+
+    //* Raw (not decoded) values, nullopt when missing
+    std::optional<std::string_view> queryParam(std::string_view name) const;
+    std::optional<std::string_view> cookie(std::string_view name) const;
+    const Params& queryParams() const;
+    const Params& cookies() const;
+
+private:
+    void addField(std::string_view name, std::string_view value);
+
+    std::string_view method_;
+    std::string_view target_;
+    std::string_view path_;
+    std::string_view query_;
+    std::string_view version_;
+    std::string_view body_;
+    std::string_view clientAddress_;
+
+    std::vector<Field> fields_;
+    std::array<std::string_view, static_cast<std::size_t>(Header::Count)> common_{};
+
+    mutable Params queryParams_;
+    mutable Params cookies_;
+    mutable bool queryParsed_ = false;
+    mutable bool cookiesParsed_ = false;
+};
+
+//* What a handler fills in. Defaults to 200 text/plain with an empty body.
+//* Bodies are moved in (or referenced, for static data), never copied on the way to the socket.
+class Response
+{
+public:
+    Response& status(std::uint16_t code) noexcept;
+    //* Both throw std::invalid_argument when the name isn't a token or the value holds CR, LF or NUL,
+    //* the client then gets a 500 instead of a split response
+    Response& header(std::string_view name, std::string_view value);
+    Response& contentType(std::string_view type);
+    Response& body(std::string body) noexcept;
+    //* For data that outlives the response, e.g. string literals. No copy at all
+    Response& staticBody(std::string_view body) noexcept;
+
+    std::uint16_t statusCode() const noexcept { return status_; }
+    std::string_view contentTypeView() const noexcept { return contentType_; }
+    //* Extra headers as formatted "Name: value\r\n" lines, for writers other than serializeHead
+    std::string_view headerLines() const noexcept { return headers_; }
+    std::string_view bodyView() const noexcept { return ownsBody_ ? std::string_view(body_) : staticBody_; }
+
+    //* Appends status line and headers to out. The body is left out so it can be written straight from here
+    void serializeHead(std::string& out, bool keepAlive) const;
+    void reset() noexcept;
+
+    static std::string_view reason(std::uint16_t code) noexcept;
+
+private:
+    std::uint16_t status_ = 200;
+    std::string contentType_ = "text/plain";
+    std::string headers_;  //? already formatted "Name: value\r\n" lines
+    std::string body_;
+    std::string_view staticBody_;
+    bool ownsBody_ = true;
+};
+}  // namespace http
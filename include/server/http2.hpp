@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <server/event_loop.hpp>
+#include <server/hpack.hpp>
+#include <server/http.hpp>
+#include <server/task.hpp>
+
+namespace server
+{
+class Server;
+class TcpServer;
+}  // namespace server
+
+//* HTTP/2 over cleartext (h2c, RFC 9113), both with prior knowledge and through Upgrade: h2c
+namespace http2
+{
+constexpr std::string_view preface{"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"};
+//* What an HTTP/1 parser sees of the preface, it ends with an empty line
+constexpr std::string_view prefaceHead{"PRI * HTTP/2.0\r\n\r\n"};
+
+enum class FrameType : std::uint8_t
+{
+    Data = 0,
+    Headers,
+    Priority,
+    RstStream,
+    Settings,
+    PushPromise,
+    Ping,
+    GoAway,
+    WindowUpdate,
+    Continuation
+};
+
+enum class ErrorCode : std::uint32_t
+{
+    NoError = 0,
+    ProtocolError,
+    InternalError,
+    FlowControlError,
+    SettingsTimeout,
+    StreamClosed,
+    FrameSizeError,
+    RefusedStream,
+    Cancel,
+    CompressionError,
+    ConnectError,
+    EnhanceYourCalm,
+    InadequateSecurity,
+    Http11Required
+};
+
+//* true for an HTTP/1.1 request asking to switch with Upgrade: h2c and an HTTP2-Settings header
+bool wantsUpgrade(const http::Request& request);
+
+//* Server preface followed by GOAWAY, for a prior knowledge client that is turned away before being served
+std::string refuseConnection(ErrorCode code);
+
+//* One h2c connection. Every stream gets its own coroutine, so hundreds of requests run concurrently on
+//* one socket. Frames produced during one loop iteration go out in a single send.
+class Connection
+{
+public:
+    //* Streams are routed by server.route(listener, ...), the same call HTTP/1 requests take.
+    //* clientAddress has to outlive the connection
+    Connection(int fd, server::Server& server, const server::TcpServer& listener, std::string_view clientAddress);
+    ~Connection();
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+    Connection(Connection&&) = delete;
+    Connection& operator=(Connection&&) = delete;
+
+    //* Called with every chunk read from the socket
+    void onReceive(std::move_only_function<void(std::string_view)> hook) { onReceive_ = std::move(hook); }
+
+    //* Serves the connection until the peer is gone, then waits for its streams to finish.
+    //* received holds bytes already read from the socket. With upgrade, the request becomes stream 1 and
+    //* the 101 response is sent first, the request doesn't have to outlive the first suspension
+    coro::Task<> run(std::string received, const http::Request* upgrade = nullptr);
+
+    static constexpr std::uint32_t maxConcurrentStreams = 256;
+    static constexpr std::uint32_t defaultWindow = 65535;
+    static constexpr std::uint32_t maxFrameSize = 16384;
+    //* connection receive window, much bigger than one stream's so uploads on many streams don't stall
+    static constexpr std::uint32_t connectionWindow = 1 << 20;
+    //* unsent output past which the connection stops reading and stops queueing response bodies
+    static constexpr std::size_t maxBufferedOutput = 1 << 20;
+    //* PING and SETTINGS acks and RST_STREAMs waiting to be sent. More means the peer makes us answer
+    //* faster than it reads, the connection is closed with ENHANCE_YOUR_CALM
+    static constexpr std::size_t maxQueuedControlFrames = 1024;
+
+private:
+    struct Stream
+    {
+        std::uint32_t id;
+        std::vector<hpack::HeaderField> fields;  //? the request views point in here
+        std::string cookies;
+        std::string body;
+        http::Request request;
+        http::Response response;
+        std::int64_t sendWindow;
+        std::int64_t receiveWindow = defaultWindow;
+        std::string_view unsent;  //? body bytes still waiting for flow control window
+        bool remoteClosed = false;
+        bool running = false;
+        bool reset = false;
+    };
+
+    coro::Task<bool> readMore();
+    bool processFrames();
+    bool handleFrame(FrameType type, std::uint8_t flags, std::uint32_t streamId, std::span<const std::uint8_t> payload);
+    bool handleHeaders(std::uint8_t flags, std::uint32_t streamId, std::span<const std::uint8_t> payload);
+    bool finishHeaders();
+    bool handleData(std::uint8_t flags, std::uint32_t streamId, std::span<const std::uint8_t> payload);
+    bool handleSettings(std::uint8_t flags, std::uint32_t streamId, std::span<const std::uint8_t> payload);
+    bool applySetting(std::uint16_t id, std::uint32_t value);
+    bool handleWindowUpdate(std::uint32_t streamId, std::span<const std::uint8_t> payload);
+    void handleReset(std::uint32_t streamId);
+
+    bool buildRequest(Stream& stream);
+    void upgradeFrom(const http::Request& request);
+    void start(Stream& stream);
+    coro::Task<> serve(Stream* stream);
+    void respond(Stream& stream);
+    void pump();
+    void close(Stream& stream);
+
+    void writeFrame(FrameType type, std::uint8_t flags, std::uint32_t streamId, std::string_view payload);
+    void writeFrameHeader(std::size_t length, FrameType type, std::uint8_t flags, std::uint32_t streamId);
+    void writeSettings();
+    void writeWindowUpdate(std::uint32_t streamId, std::uint32_t increment);
+    void resetStream(std::uint32_t streamId, ErrorCode code);
+    bool wasReset(std::uint32_t streamId) const;
+    bool goAway(ErrorCode code);
+
+    void scheduleFlush();
+    coro::Task<> flush();
+    void taskFinished();
+    bool backlogged() const noexcept { return out_.size() + sending_.size() > maxBufferedOutput; }
+
+    struct DrainAwaiter
+    {
+        Connection& connection;
+
+        bool await_ready() const noexcept { return connection.tasks_ == 0; }
+        void await_suspend(std::coroutine_handle<> handle) noexcept { connection.drained_ = handle; }
+        static void await_resume() noexcept {}
+    };
+
+    //* the reader waits here while the output is backlogged, flush() wakes it up
+    struct DrainedOutputAwaiter
+    {
+        Connection& connection;
+
+        bool await_ready() const noexcept { return !connection.backlogged(); }
+        void await_suspend(std::coroutine_handle<> handle) noexcept { connection.reader_ = handle; }
+        static void await_resume() noexcept {}
+    };
+
+    int fd_;
+    server::Server& server_;
+    const server::TcpServer& listener_;
+    std::string_view clientAddress_;
+    std::move_only_function<void(std::string_view)> onReceive_;
+    server::EventLoop* loop_ = nullptr;
+
+    hpack::Decoder decoder_;
+    hpack::Encoder encoder_;
+
+    std::string in_;
+    std::string out_;      //? frames waiting for the next flush
+    std::string sending_;  //? frames the flush is writing right now
+    std::size_t queuedControl_ = 0;   //? control frames in out_
+    std::size_t sendingControl_ = 0;  //? control frames in sending_
+
+    std::unordered_map<std::uint32_t, std::unique_ptr<Stream>> streams_;
+    std::vector<Stream*> sendQueue_;  //? streams with response body left, served round robin
+    std::uint32_t lastStreamId_ = 0;
+    //* streams we sent RST_STREAM on, the client's frames for them may still be on the way
+    std::deque<std::uint32_t> recentlyReset_;
+
+    //* header block split over HEADERS + CONTINUATION frames
+    std::string headerBlock_;
+    std::uint32_t headerStream_ = 0;
+    std::uint8_t headerFlags_ = 0;
+    bool expectContinuation_ = false;
+    std::vector<hpack::HeaderField> decoded_;
+
+    std::int64_t sendWindow_ = defaultWindow;
+    std::int64_t receiveWindow_ = connectionWindow;
+    std::int64_t peerInitialWindow_ = defaultWindow;
+    std::size_t peerMaxFrameSize_ = maxFrameSize;
+
+    bool settingsReceived_ = false;
+    bool goAwaySent_ = false;
+    bool peerGoAway_ = false;
+    bool flushing_ = false;
+    bool broken_ = false;
+
+    std::size_t tasks_ = 0;  //? stream coroutines and flush still running, they point back here
+    std::coroutine_handle<> drained_;
+    std::coroutine_handle<> reader_;
+};
+}  // namespace http2
@@ -1,12 +1,24 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
-#include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <mutex>
-#include <thread>
+#include <vector>
+#include <server/capture.hpp>
+#include <server/event_loop.hpp>
+#include <server/http.hpp>
+#include <server/task.hpp>
+#include <server/thread_pool.hpp>
 #include <server/utils.hpp>
 #include <tracy/Tracy.hpp>
 
@@ -14,93 +26,173 @@ namespace router
 {
 class Router;
 
-using RouteHandler = std::function<std::string(const std::string&, const std::string&)>;
-
 enum class RequestType : std::uint8_t { GET = 0, POST, PUT, DELETE };
 
+//* throws std::invalid_argument for methods the router doesn't know
+RequestType toRequestType(std::string_view requestT);
 
-RequestType toRequestType(const std::string& requestT);
-
-
-
-class RequestHandler {
+//* A registered handler. The callable's type is erased into two plain pointers (thunk + state),
+//* so a dispatch is one indirect call, no std::function and no allocation.
+class Route
+{
 public:
-    RequestHandler() = default;
-
-    virtual ~RequestHandler() = default;
-    RequestHandler(const RequestHandler&) = delete;
-    RequestHandler& operator=(const RequestHandler&) = delete;
-    RequestHandler(RequestHandler&&) = delete;
-    RequestHandler& operator=(RequestHandler&&) = delete;
-
-    virtual std::string handler(const std::string& path, const std::string& body) = 0;
-    virtual RequestType getType() const = 0;
-};
+    using SyncFn = void (*)(void*, const http::Request&, http::Response&);
+    using AsyncFn = coro::Task<> (*)(void*, const http::Request&, http::Response&);
 
-class GETHandler final : public RequestHandler {
-public:
-    std::string handler(const std::string& path, const std::string& body) override;
-    RequestType getType() const override;
-};
-class POSTHandler final : public RequestHandler {
-public:
-    std::string handler(const std::string& path, const std::string& body) override;
-    RequestType getType() const override;
-};
+    Route(SyncFn sync, AsyncFn async, void* state, void (*destroy)(void*)) noexcept :
+        sync_(sync), async_(async), state_(state, destroy) {}
 
-class PUTHandler final : public RequestHandler {
-public:
-    std::string handler(const std::string& path, const std::string& body) override;
-    RequestType getType() const override;
-};
+    //* Sync handlers run inline on the loop, async ones get awaited
+    bool isAsync() const noexcept { return async_ != nullptr; }
+    void call(const http::Request& request, http::Response& response) const { sync_(state_.get(), request, response); }
+    coro::Task<> callAsync(const http::Request& request, http::Response& response) const
+    {
+        return async_(state_.get(), request, response);
+    }
 
-class DELETEHandler final : public RequestHandler {
-public:
-    std::string handler(const std::string& path, const std::string& body) override;
-    RequestType getType() const override;
+private:
+    SyncFn sync_;
+    AsyncFn async_;
+    std::unique_ptr<void, void (*)(void*)> state_;
 };
 
-class RequestHandlerFactory {
-public:
-    static std::unique_ptr<RequestHandler> createHandler(RequestType type);
-};
+namespace detail
+{
+    //* Adapters for the (path, body) string handlers, they still get std::string copies like before.
+    //* The blocking kind is offloaded to the worker pool so it can't stall the loop
+    template <typename F>
+    coro::Task<> runLegacy(F& handler, const http::Request& request, http::Response& response)
+    {
+        const std::string path(request.path());
+        const std::string body(request.body());
+        response.body(co_await coro::offload([&handler, &path, &body] { return std::string(handler(path, body)); }));
+    }
+
+    template <typename F>
+    coro::Task<> runLegacyAsync(F& handler, const http::Request& request, http::Response& response)
+    {
+        const std::string path(request.path());
+        const std::string body(request.body());
+        response.body(co_await handler(path, body));
+    }
+}  // namespace detail
 
 class Router
 {
 public:
-    void addRoute(RequestType type, const std::string& path, RouteHandler handler);
-    RouteHandler getHandler(RequestType type, const std::string& path) const;
+    //* Accepts any of
+    //*   void(const http::Request&, http::Response&)                  runs inline on the loop, keep it quick
+    //*   coro::Task<>(const http::Request&, http::Response&)          coroutine, can await sockets/timers/offload
+    //*   std::string(const std::string& path, const std::string& body)  old style, runs on the worker pool
+    //*   coro::Task<std::string>(const std::string&, const std::string&)
+    template <typename F>
+    void addRoute(RequestType type, std::string_view path, F handler);
+
+    const Route* getHandler(RequestType type, std::string_view path) const;
 
 private:
-    struct Hash {
-        std::size_t operator()(const std::pair<RequestType, std::string>& p) const {
-            const auto h1 = std::hash<int>()(std::to_underlying(p.first));
-            const auto h2 = std::hash<std::string>()(p.second);
-            return h1 ^ (h2 << 1);
-        }
-    };
-    std::unordered_map<std::pair<RequestType, std::string>, RouteHandler, Hash> routes_;
+    void insert(RequestType type, std::string_view path, Route route);
+
+    template <typename F>
+    static void destroy(void* state) { delete static_cast<F*>(state); }
+
+    //* one map per method, looked up with the string_view straight from the request buffer
+    std::array<std::unordered_map<std::string, Route, utils::TransparentHash, utils::TransparentEqual>, 4> routes_;
 };
+
+template <typename F>
+void Router::addRoute(RequestType type, std::string_view path, F handler)
+{
+    using Request = const http::Request&;
+    using Response = http::Response&;
+    if constexpr (std::is_invocable_r_v<coro::Task<>, F&, Request, Response>) {
+        insert(type, path, Route(nullptr, [](void* state, Request request, Response response) {
+            return (*static_cast<F*>(state))(request, response);
+        }, new F(std::move(handler)), &destroy<F>));
+    } else if constexpr (std::is_invocable_r_v<void, F&, Request, Response>) {
+        insert(type, path, Route([](void* state, Request request, Response response) {
+            (*static_cast<F*>(state))(request, response);
+        }, nullptr, new F(std::move(handler)), &destroy<F>));
+    } else if constexpr (std::is_invocable_r_v<coro::Task<std::string>, F&, const std::string&, const std::string&>) {
+        insert(type, path, Route(nullptr, [](void* state, Request request, Response response) {
+            return detail::runLegacyAsync(*static_cast<F*>(state), request, response);
+        }, new F(std::move(handler)), &destroy<F>));
+    } else {
+        static_assert(std::is_invocable_r_v<std::string, F&, const std::string&, const std::string&>,
+                      "unsupported route handler signature");
+        insert(type, path, Route(nullptr, [](void* state, Request request, Response response) {
+            return detail::runLegacy(*static_cast<F*>(state), request, response);
+        }, new F(std::move(handler)), &destroy<F>));
+    }
+}
 };//namespace router
 
+namespace http2
+{
+class Connection;
+}  // namespace http2
+
 namespace server
 {
+//* One listening port. Owns a SO_REUSEPORT socket per event loop so the kernel spreads
+//* new connections over all loops, and maps Host headers to routers for virtual hosts.
 class TcpServer {
 public:
-    TcpServer(uint16_t port, router::Router& router);
+    TcpServer(uint16_t port, router::Router& router, std::size_t sockets = 1);
     ~TcpServer();
 
     TcpServer(const TcpServer&) = delete;
     TcpServer& operator=(const TcpServer&) = delete;
-    TcpServer(TcpServer&&) noexcept;
-    TcpServer& operator=(TcpServer&&) noexcept;
+    TcpServer(TcpServer&&) = delete;
+    TcpServer& operator=(TcpServer&&) = delete;
 
-    void run();
+    TcpServer& addVirtualHost(std::string_view host, router::Router& router);
+    //* nullptr when the host has no virtual host on this port
+    router::Router* virtualHost(std::string_view host) const;
+    bool hasVirtualHosts() const noexcept { return !virtualHosts_.empty(); }
+    router::Router& defaultRouter() const noexcept { return router_; }
+    //* h2c (prior knowledge and Upgrade: h2c) is accepted unless turned off here
+    TcpServer& enableHttp2(const bool enabled) noexcept { http2_ = enabled; return *this; }
+    bool http2Enabled() const noexcept { return http2_; }
+
+    uint16_t port() const noexcept { return port_; }
+    int fd(std::size_t loopIndex) const noexcept { return serverFds_[loopIndex % serverFds_.size()]; }
 
 private:
-    int serverFd_;
+    std::vector<int> serverFds_;
+    uint16_t port_;
     router::Router& router_;
-    // ! Don't know how to make it work xd
+    std::unordered_map<std::string, router::Router*, utils::TransparentHash, utils::TransparentEqual> virtualHosts_;
+    bool http2_ = true;
+};
+
+//* Shared runtime for every listener: one event loop per core, one worker pool and one
+//* rate-limit table. Adding a port or a virtual host costs a socket and a map entry, not threads.
+class Server {
+public:
+    explicit Server(std::size_t loops = std::max(1U, std::thread::hardware_concurrency()), std::size_t workers = 4);
+    ~Server();
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+    Server(Server&&) = delete;
+    Server& operator=(Server&&) = delete;
+
+    //* Call before run(). The returned listener can get its own virtual hosts
+    TcpServer& listen(uint16_t port, router::Router& router);
+    //* Virtual host valid on every port, a listener's own virtual hosts take priority
+    Server& addVirtualHost(std::string_view host, router::Router& router);
+    //* Call before run(). Records every connection's incoming bytes to path, see TrafficCapture
+    Server& enableCapture(const std::string& path);
+    //* The per-IP limiter (one connection per millisecond) is on by default. Turn it off for load tests and
+    //* replays, where every connection comes from the same address
+    Server& rateLimit(bool enabled);
+
+    //* Blocks, the calling thread runs the first loop
+    void run();
+    void stop();
+
+private:
     std::unordered_map<
         std::string,
         std::chrono::steady_clock::time_point,
@@ -109,30 +201,35 @@ private:
     > lastIp_;
 
     std::mutex ipMutex_;
+    bool rateLimit_ = true;
 
-    std::atomic<bool> running_{true};
-    std::mutex threadMutex_;
-    //? jthread implementation
-    std::vector<std::thread> serverThreads_;
-
-    //*Dispatcher implementiation
-    std::queue<int> clientQueue_;
-    std::mutex clientQueueMutex_;
-    std::condition_variable clientQueueCond_; //? https://en.cppreference.com/w/cpp/thread/condition_variable.html
-    std::thread dispatcherThread_;
-    std::vector<std::thread> workerThreads_;
-    void workerLoop();
-    bool stop_ = false;
-    void dispatchLoop();
+    //* declared before the loops so it outlives every connection that might still write to it
+    std::unique_ptr<TrafficCapture> capture_;
+    std::atomic<std::uint64_t> nextConnection_{0};
+
+    //* Blocking work (sync handlers) goes to the workers, sockets are driven by the loops
+    ThreadPool workers_;
+    std::vector<std::unique_ptr<EventLoop>> loops_;
+    std::vector<std::thread> loopThreads_;
+    std::vector<std::unique_ptr<TcpServer>> listeners_;
+    std::unordered_map<std::string, router::Router*, utils::TransparentHash, utils::TransparentEqual> virtualHosts_;
 
     //*Loggin
     std::mutex loggingMutex_;
 
-
-    void cleanupFinishedThreads();
-    void handleClient(int clientFd);
+    coro::Task<> acceptLoop(TcpServer& listener, int serverFd);
+    coro::Task<> handleClient(TcpServer& listener, int clientFd);
+    //* Reads and answers requests until the connection ends, the caller closes the socket
+    coro::Task<> serveConnection(const TcpServer& listener, int clientFd, const std::string& clientIP, std::uint64_t connection);
+    //? h2 streams are routed through route() as well
+    friend class http2::Connection;
+
+    //* Router lookup and handler call, shared by HTTP/1 and HTTP/2. Never throws, errors end up in the response
+    coro::Task<> route(const TcpServer& listener, const http::Request& request, http::Response& response);
+    coro::Task<> serveHttp2(const TcpServer& listener, int clientFd, const std::string& clientIP, std::uint64_t connection,
+                            std::string received, const http::Request* upgrade);
+    router::Router& routerFor(const TcpServer& listener, const http::Request& request) const;
     bool blockTooManyRequests(const std::string& ip);
-    static std::string extractBody(const std::string& request);
 
 };
 }
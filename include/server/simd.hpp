@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+//* Vectorized byte scanning for the HTTP parser.
+//* Kernels are picked once at startup (AVX2, SSE4.2 or scalar) depending on what the CPU supports,
+//* every kernel returns exactly what the scalar version returns.
+namespace simd
+{
+    enum class Level : unsigned char { Scalar = 0, SSE42, AVX2 };
+
+    //* Level the dispatcher picked for this CPU
+    Level activeLevel() noexcept;
+    //* Forces a level, lower than what the CPU supports only. Meant for tests and benchmarks
+    void forceLevel(Level level) noexcept;
+
+    //* Position of the first "\r\n\r\n" at or after from, npos if there is none
+    std::size_t findHeaderEnd(std::string_view data, std::size_t from = 0) noexcept;
+    //* Position of the first "\r\n", npos if there is none
+    std::size_t findCrlf(std::string_view data) noexcept;
+    std::size_t findByte(std::string_view data, char byte) noexcept;
+    //* One pass over a header block, writes the offset of every "\r\n" into out.
+    //* Returns how many were found, stops early when out is full
+    std::size_t lineEnds(std::string_view data, std::span<std::uint32_t> out) noexcept;
+    //* RFC 9110 token (header names, methods). Empty strings aren't tokens
+    bool isToken(std::string_view data) noexcept;
+    //* lower has to be lowercase already, e.g. equalsIgnoreCase(value, "keep-alive")
+    bool equalsIgnoreCase(std::string_view data, std::string_view lower) noexcept;
+    //* ASCII lowercase in place, other bytes are left alone
+    void toLower(std::span<char> data) noexcept;
+
+    namespace scalar
+    {
+        std::size_t findHeaderEnd(std::string_view data, std::size_t from) noexcept;
+        std::size_t findCrlf(std::string_view data) noexcept;
+        std::size_t findByte(std::string_view data, char byte) noexcept;
+        std::size_t lineEnds(std::string_view data, std::span<std::uint32_t> out) noexcept;
+        bool isToken(std::string_view data) noexcept;
+        bool equalsIgnoreCase(std::string_view data, std::string_view lower) noexcept;
+        void toLower(std::span<char> data) noexcept;
+    }  // namespace scalar
+}  // namespace simd
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace coro
+{
+//* Coroutine frames are recycled through size-classed, thread-local free lists.
+//* A connection allocates a handful of frames per request, so going through malloc
+//* for every one of them is wasted work once the server is warmed up.
+class FramePool
+{
+public:
+    static void* allocate(std::size_t size);
+    static void deallocate(void* ptr, std::size_t size) noexcept;
+
+private:
+    static constexpr std::size_t kGranularity = 64;
+    static constexpr std::size_t kClasses = 64;  //? frames up to 4 KiB are pooled, bigger ones go to the heap
+    static constexpr std::size_t kMaxCachedPerClass = 1024;
+
+    struct FreeNode
+    {
+        FreeNode* next;
+    };
+
+    struct Cache
+    {
+        std::array<FreeNode*, kClasses> heads{};
+        std::array<std::size_t, kClasses> counts{};
+
+        Cache() = default;
+        ~Cache();
+        Cache(const Cache&) = delete;
+        Cache& operator=(const Cache&) = delete;
+        Cache(Cache&&) = delete;
+        Cache& operator=(Cache&&) = delete;
+    };
+
+    static Cache& cache() noexcept;
+    static constexpr std::size_t sizeClass(const std::size_t size) noexcept
+    {
+        return (size + kGranularity - 1) / kGranularity - 1;
+    }
+};
+
+template <typename T = void>
+class Task;
+
+namespace detail
+{
+    struct PromiseBase
+    {
+        std::coroutine_handle<> continuation = std::noop_coroutine();
+        std::exception_ptr exception;
+        //* Detached tasks (spawned on an EventLoop) have nobody awaiting them, they free themselves
+        bool detached = false;
+
+        static void* operator new(const std::size_t size)
+        {
+            return FramePool::allocate(size);
+        }
+
+        static void operator delete(void* ptr, const std::size_t size) noexcept
+        {
+            FramePool::deallocate(ptr, size);
+        }
+
+        struct FinalAwaiter
+        {
+            static bool await_ready() noexcept { return false; }
+
+            template <typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+            {
+                PromiseBase& promise = handle.promise();
+                if (promise.detached)
+                {
+                    handle.destroy();
+                    return std::noop_coroutine();
+                }
+                //* symmetric transfer, resuming the awaiting coroutine doesn't grow the stack
+                return promise.continuation;
+            }
+
+            static void await_resume() noexcept {}
+        };
+
+        static std::suspend_always initial_suspend() noexcept { return {}; }
+        static FinalAwaiter final_suspend() noexcept { return {}; }
+        void unhandled_exception() noexcept { exception = std::current_exception(); }
+    };
+
+    template <typename T>
+    struct Promise : PromiseBase
+    {
+        std::optional<T> value;
+
+        Task<T> get_return_object() noexcept;
+
+        template <typename U>
+        void return_value(U&& result)
+        {
+            value.emplace(std::forward<U>(result));
+        }
+
+        T result()
+        {
+            if (exception)
+            {
+                std::rethrow_exception(exception);
+            }
+            return std::move(*value);
+        }
+    };
+
+    template <>
+    struct Promise<void> : PromiseBase
+    {
+        Task<void> get_return_object() noexcept;
+
+        static void return_void() noexcept {}
+
+        void result() const
+        {
+            if (exception)
+            {
+                std::rethrow_exception(exception);
+            }
+        }
+    };
+}  // namespace detail
+
+//* Lazily started coroutine. Nothing runs until the task is awaited or spawned on an EventLoop.
+template <typename T>
+class [[nodiscard]] Task
+{
+public:
+    using promise_type = detail::Promise<T>;
+
+    Task() = default;
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+    ~Task()
+    {
+        if (handle_)
+        {
+            handle_.destroy();
+        }
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+
+    Task& operator=(Task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (handle_)
+            {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+
+    bool await_ready() const noexcept { return !handle_ || handle_.done(); }
+
+    std::coroutine_handle<> await_suspend(const std::coroutine_handle<> awaiting) noexcept
+    {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+
+    T await_resume() { return handle_.promise().result(); }
+
+    //* Gives up ownership of the frame, used by EventLoop::spawn
+    std::coroutine_handle<promise_type> release() noexcept { return std::exchange(handle_, {}); }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail
+{
+    template <typename T>
+    Task<T> Promise<T>::get_return_object() noexcept
+    {
+        return Task<T>{std::coroutine_handle<Promise>::from_promise(*this)};
+    }
+
+    inline Task<void> Promise<void>::get_return_object() noexcept
+    {
+        return Task<void>{std::coroutine_handle<Promise>::from_promise(*this)};
+    }
+}  // namespace detail
+}  // namespace coro
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace server
+{
+//* Plain worker pool for blocking work (sync route handlers, database calls, file reads).
+//* The event loop never blocks itself, it hands these jobs over with coro::offload.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(std::size_t threads, const char* name = "WorkerThread");
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ThreadPool(ThreadPool&&) = delete;
+    ThreadPool& operator=(ThreadPool&&) = delete;
+
+    void submit(std::move_only_function<void()> job);
+    std::size_t size() const noexcept { return threads_.size(); }
+
+private:
+    void workerLoop(const char* name);
+
+    std::mutex mutex_;
+    std::condition_variable cond_;  //? https://en.cppreference.com/w/cpp/thread/condition_variable.html
+    std::queue<std::move_only_function<void()>> jobs_;
+    bool stop_ = false;
+    std::vector<std::thread> threads_;
+};
+}  // namespace server
@@ -2,42 +2,31 @@
 // Created by Filip Sokołowski on 25/05/2025.
 //
 #pragma once
-#include <sys/socket.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <server/simd.hpp>
 
 
 namespace utils
 {
-    //* Function totally taken from stack overflow. But it works :>
-    inline std::string trim(const std::string& s) {
+    //* Strips surrounding whitespace without a copy, for views into the request buffer
+    inline std::string_view trimView(std::string_view s) {
         const auto start = s.find_first_not_of(" \t\r\n");
         const auto end = s.find_last_not_of(" \t\r\n");
-        return (start == std::string::npos || end == std::string::npos)
-            ? ""
-            : s.substr(start, end - start + 1);
+        return (start == std::string_view::npos) ? std::string_view{} : s.substr(start, end - start + 1);
     }
 
-    static std::string readRequest(const int fd) {
-        std::vector<char> buffer(4096);
-        // Checking if length of the request isn't too long
-        if (const ssize_t bytes = recv(fd, buffer.data(), buffer.size() - 1, 0); bytes > 0) {
-            buffer[bytes] = '\0';
-            return {buffer.data()};
-        }
-        return {};
-    }
-
-    bool inline shouldKeepAlive(const std::string& version, const std::unordered_map<std::string, std::string>& headers) {
-        auto it = headers.find("connection");
-        const std::string conn = (it != headers.end()) ? headers.at("connection") : "";
-
+    bool inline shouldKeepAlive(const std::string_view version, const std::string_view conn) {
+        //* Connection options are case-insensitive, "Keep-Alive" is what most HTTP/1.0 clients send
         if (version == "HTTP/1.1")
         {
-            return conn != "close";
+            return !simd::equalsIgnoreCase(conn, "close");
         }
         //* else statys here for the feature
         if (version == "HTTP/1.0")
         {
-            return conn == "keep-alive";
+            return simd::equalsIgnoreCase(conn, "keep-alive");
         }
         return false;
     };
@@ -53,7 +42,7 @@ namespace utils
      */
     //They all work without copying right now :>
     struct TransparentHash {
-        using IsTransparent = void;
+        using is_transparent = void; //NOLINT(readability-identifier-naming) the standard looks for exactly this name
 
         size_t operator()(std::string_view sv) const noexcept {
             return std::hash<std::string_view>{}(sv);
@@ -69,7 +58,7 @@ namespace utils
     };
 
     struct TransparentEqual {
-        using IsTransparent = void;
+        using is_transparent = void; //NOLINT(readability-identifier-naming) the standard looks for exactly this name
         bool operator()(std::string_view lhs, std::string_view rhs) const noexcept {
             return lhs == rhs;
         }
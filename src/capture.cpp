@@ -0,0 +1,134 @@
+#include "server/capture.hpp"
+#include "server/exceptions.hpp"
+#include "tracy/Tracy.hpp"
+
+#include <array>
+#include <bit>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+template <typename T>
+void appendLittleEndian(std::string& out, T value)
+{
+    if constexpr (std::endian::native == std::endian::big)
+    {
+        value = std::byteswap(value);
+    }
+    std::array<char, sizeof(T)> bytes{};
+    std::memcpy(bytes.data(), &value, sizeof(T));
+    out.append(bytes.data(), bytes.size());
+}
+}  // namespace
+
+server::TrafficCapture::TrafficCapture(const std::string& path, const std::size_t maxPendingBytes) :
+    file_(std::fopen(path.c_str(), "wb")), maxPendingBytes_(maxPendingBytes)
+{
+    if (file_ == nullptr)
+    {
+        throw exceptions::CaptureException("Could not open capture file: " + path);
+    }
+    std::fwrite(magic.data(), 1, magic.size(), file_);
+    writer_ = std::thread([this] { writerLoop(); });
+}
+
+server::TrafficCapture::~TrafficCapture()
+{
+    {
+        const std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_one();
+    if (writer_.joinable())
+    {
+        writer_.join();
+    }
+    std::fclose(file_);
+    if (const std::uint64_t lost = dropped(); lost > 0)
+    {
+        std::cerr << "[CAPTURE] dropped " << lost << " records, " << truncatedConnections() << " connections truncated\n";
+    }
+}
+
+void server::TrafficCapture::record(const Kind kind, const std::uint64_t connection, const std::uint16_t port,
+                                    const std::string_view bytes)
+{
+    bool wake = false;
+    {
+        const std::lock_guard lock(mutex_);
+        wake = pending_.empty();
+        if (const auto it = truncated_.find(connection); it != truncated_.end())
+        {
+            //* the stream has a hole already, nothing after it is worth recording
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            if (kind == Kind::Close)
+            {
+                truncated_.erase(it);
+            }
+            return;
+        }
+        if (pending_.size() + recordHeaderSize + bytes.size() > maxPendingBytes_)
+        {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            truncatedConnections_.fetch_add(1, std::memory_order_relaxed);
+            if (kind != Kind::Close)
+            {
+                truncated_.insert(connection);
+            }
+            //* the marker may go over the limit, it's one header per connection
+            append(Kind::Truncated, connection, port, {});
+        }
+        else
+        {
+            append(kind, connection, port, bytes);
+        }
+    }
+    if (wake)
+    {
+        cond_.notify_one();
+    }
+}
+
+void server::TrafficCapture::append(const Kind kind, const std::uint64_t connection, const std::uint16_t port,
+                                    const std::string_view bytes)
+{
+    const auto now = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count());
+    appendLittleEndian(pending_, static_cast<std::uint8_t>(kind));
+    appendLittleEndian(pending_, now);
+    appendLittleEndian(pending_, connection);
+    appendLittleEndian(pending_, port);
+    appendLittleEndian(pending_, static_cast<std::uint32_t>(bytes.size()));
+    pending_.append(bytes);
+}
+
+void server::TrafficCapture::writerLoop()
+{
+    tracy::SetThreadName("CaptureWriter");
+    std::string batch;
+    std::uint64_t reported = 0;
+    while (true)
+    {
+        {
+            std::unique_lock lock(mutex_);
+            cond_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+            if (pending_.empty() && stop_)
+            {
+                return;
+            }
+            //* swap keeps both buffers' capacity, so steady state capture doesn't allocate
+            batch.swap(pending_);
+        }
+        ZoneScopedN("TrafficCapture::write");  // NOLINT
+        std::fwrite(batch.data(), 1, batch.size(), file_);
+        std::fflush(file_);
+        batch.clear();
+        //* reported from here because the destructor doesn't run when the server is killed
+        if (const std::uint64_t truncated = truncatedConnections(); truncated != reported)
+        {
+            reported = truncated;
+            std::cerr << "[CAPTURE] the writer can't keep up, " << truncated << " connections truncated so far\n";
+        }
+    }
+}
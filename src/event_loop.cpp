@@ -0,0 +1,330 @@
+#include "server/event_loop.hpp"
+#include "server/exceptions.hpp"
+#include "tracy/Tracy.hpp"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <stdexcept>
+
+namespace
+{
+thread_local server::EventLoop* currentLoop = nullptr;  // NOLINT
+}
+
+server::EventLoop::EventLoop(ThreadPool& workers) :
+    epollFd_(::epoll_create1(EPOLL_CLOEXEC)),
+    wakeFd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+    workers_(workers)
+{
+    if (epollFd_ < 0 || wakeFd_ < 0)
+    {
+        throw exceptions::EventLoopException("Could not create event loop");
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeFd_;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &ev) != 0)
+    {
+        throw exceptions::EventLoopException("Could not register wake fd");
+    }
+}
+
+server::EventLoop::~EventLoop()
+{
+    ::close(wakeFd_);
+    ::close(epollFd_);
+}
+
+server::EventLoop& server::EventLoop::current()
+{
+    if (currentLoop == nullptr)
+    {
+        throw std::logic_error("No event loop running on this thread");
+    }
+    return *currentLoop;
+}
+
+void server::EventLoop::run()
+{
+    ZoneScoped;  // NOLINT
+    currentLoop = this;
+
+    std::array<epoll_event, 256> events{};
+    while (running_)
+    {
+        const int ready = epoll_wait(epollFd_, events.data(), static_cast<int>(events.size()), nextTimeoutMs());
+        if (ready < 0 && errno != EINTR)
+        {
+            break;
+        }
+
+        for (int i = 0; i < ready; ++i)
+        {
+            const int fd = events[i].data.fd;
+            if (fd == wakeFd_)
+            {
+                std::uint64_t count = 0;
+                [[maybe_unused]] const auto n = ::read(wakeFd_, &count, sizeof(count));
+                continue;
+            }
+            dispatchIo(fd, events[i].events);
+        }
+
+        fireTimers();
+        drainPosted();
+    }
+    currentLoop = nullptr;
+}
+
+void server::EventLoop::stop()
+{
+    running_ = false;
+    constexpr std::uint64_t one = 1;
+    [[maybe_unused]] const auto n = ::write(wakeFd_, &one, sizeof(one));
+}
+
+void server::EventLoop::spawn(coro::Task<> task)
+{
+    const auto handle = task.release();
+    handle.promise().detached = true;
+    post(handle);
+}
+
+void server::EventLoop::post(const std::coroutine_handle<> handle)
+{
+    bool wake = false;
+    {
+        const std::lock_guard lock(postedMutex_);
+        posted_.push_back(handle);
+        //* one eventfd write per batch is enough, the loop drains everything at once
+        wake = !std::exchange(wakePending_, true);
+    }
+    if (wake)
+    {
+        constexpr std::uint64_t one = 1;
+        [[maybe_unused]] const auto n = ::write(wakeFd_, &one, sizeof(one));
+    }
+}
+
+void server::EventLoop::close(const int fd)
+{
+    if (fd >= 0 && static_cast<std::size_t>(fd) < waiters_.size())
+    {
+        waiters_[fd] = {};
+    }
+    ::close(fd);
+}
+
+void server::EventLoop::addWaiter(const int fd, const bool write, const std::coroutine_handle<> handle,
+                                  const Clock::time_point deadline)
+{
+    if (static_cast<std::size_t>(fd) >= waiters_.size())
+    {
+        waiters_.resize(static_cast<std::size_t>(fd) + 1);
+    }
+    IoWaiters& w = waiters_[fd];
+    if (write)
+    {
+        w.writer = handle;
+    }
+    else
+    {
+        w.reader = handle;
+        w.readTicket = ++readTicket_;
+        if (deadline != Clock::time_point::max())
+        {
+            timers_.push({deadline, timerSeq_++, handle, fd, w.readTicket});
+        }
+    }
+    arm(fd);
+}
+
+void server::EventLoop::arm(const int fd)
+{
+    IoWaiters& w = waiters_[fd];
+    epoll_event ev{};
+    //* one shot, so a ready fd nobody waits on doesn't keep waking the loop
+    ev.events = EPOLLONESHOT | EPOLLRDHUP;
+    ev.events |= w.reader ? EPOLLIN : 0U;
+    ev.events |= w.writer ? EPOLLOUT : 0U;
+    ev.data.fd = fd;
+
+    int rc = epoll_ctl(epollFd_, w.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+    if (rc != 0 && w.registered && errno == ENOENT)
+    {
+        //* the fd number got closed behind our back and reused
+        rc = epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev);
+    }
+    if (rc == 0)
+    {
+        w.registered = true;
+        return;
+    }
+    //* fd can't be watched (already closed, not pollable). Wake the waiters, their next syscall reports the error
+    for (std::coroutine_handle<>* waiter : {&w.reader, &w.writer})
+    {
+        if (*waiter)
+        {
+            post(std::exchange(*waiter, {}));
+        }
+    }
+}
+
+void server::EventLoop::dispatchIo(const int fd, const std::uint32_t events)
+{
+    if (static_cast<std::size_t>(fd) >= waiters_.size())
+    {
+        return;
+    }
+    IoWaiters& w = waiters_[fd];
+    constexpr std::uint32_t failure = EPOLLERR | EPOLLHUP;
+
+    std::coroutine_handle<> reader;
+    std::coroutine_handle<> writer;
+    if ((events & (EPOLLIN | EPOLLRDHUP | failure)) != 0U)
+    {
+        reader = std::exchange(w.reader, {});
+    }
+    if ((events & (EPOLLOUT | failure)) != 0U)
+    {
+        writer = std::exchange(w.writer, {});
+    }
+    //* whoever is still waiting needs the one shot registration re-armed
+    if (w.reader || w.writer)
+    {
+        arm(fd);
+    }
+
+    if (reader)
+    {
+        reader.resume();
+    }
+    if (writer)
+    {
+        writer.resume();
+    }
+}
+
+void server::EventLoop::addTimer(const Clock::time_point deadline, const std::coroutine_handle<> handle)
+{
+    timers_.push({deadline, timerSeq_++, handle});
+}
+
+void server::EventLoop::fireTimers()
+{
+    const auto now = Clock::now();
+    while (!timers_.empty() && timers_.top().deadline <= now)
+    {
+        const Timer timer = timers_.top();
+        timers_.pop();
+        if (timer.fd >= 0)
+        {
+            //* the read deadline of a reader that got its data already, or of an fd closed since
+            if (static_cast<std::size_t>(timer.fd) >= waiters_.size() || waiters_[timer.fd].readTicket != timer.readTicket
+                || waiters_[timer.fd].reader != timer.handle)
+            {
+                continue;
+            }
+            waiters_[timer.fd].reader = {};
+        }
+        timer.handle.resume();
+    }
+}
+
+void server::EventLoop::drainPosted()
+{
+    {
+        const std::lock_guard lock(postedMutex_);
+        draining_.swap(posted_);
+        wakePending_ = false;
+    }
+    for (const std::coroutine_handle<> handle : draining_)
+    {
+        handle.resume();
+    }
+    draining_.clear();
+}
+
+int server::EventLoop::nextTimeoutMs() const
+{
+    if (timers_.empty())
+    {
+        return -1;
+    }
+    const auto left = std::chrono::ceil<std::chrono::milliseconds>(timers_.top().deadline - Clock::now());
+    return left.count() > 0 ? static_cast<int>(left.count()) : 0;
+}
+
+coro::Task<ssize_t> coro::recvSome(const int fd, std::span<char> buffer, const server::EventLoop::Clock::time_point deadline)
+{
+    while (true)
+    {
+        const ssize_t n = ::recv(fd, buffer.data(), buffer.size(), 0);
+        if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            co_return n;
+        }
+        if (deadline != server::EventLoop::Clock::time_point::max() && server::EventLoop::Clock::now() >= deadline)
+        {
+            errno = ETIMEDOUT;
+            co_return -1;
+        }
+        co_await server::EventLoop::current().readable(fd, deadline);
+    }
+}
+
+coro::Task<bool> coro::sendAll(const int fd, std::string_view data)
+{
+    while (!data.empty())
+    {
+        const ssize_t n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n >= 0)
+        {
+            data.remove_prefix(static_cast<std::size_t>(n));
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            co_return false;
+        }
+        co_await server::EventLoop::current().writable(fd);
+    }
+    co_return true;
+}
+
+coro::Task<bool> coro::sendAll(const int fd, std::string_view head, std::string_view body)
+{
+    while (!head.empty())
+    {
+        std::array<iovec, 2> parts{};
+        parts[0] = {const_cast<char*>(head.data()), head.size()};  // NOLINT(cppcoreguidelines-pro-type-const-cast) iovec is not const-correct
+        parts[1] = {const_cast<char*>(body.data()), body.size()};  // NOLINT(cppcoreguidelines-pro-type-const-cast)
+        msghdr msg{};
+        msg.msg_iov = parts.data();
+        msg.msg_iovlen = body.empty() ? 1 : 2;
+
+        const ssize_t n = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                co_return false;
+            }
+            co_await server::EventLoop::current().writable(fd);
+            continue;
+        }
+        auto written = static_cast<std::size_t>(n);
+        const std::size_t fromHead = std::min(written, head.size());
+        head.remove_prefix(fromHead);
+        body.remove_prefix(written - fromHead);
+    }
+    co_return co_await sendAll(fd, body);
+}
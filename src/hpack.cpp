@@ -0,0 +1,538 @@
+#include "server/hpack.hpp"
+#include "tracy/Tracy.hpp"
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+namespace
+{
+struct Code
+{
+    std::uint32_t bits;
+    std::uint8_t length;
+};
+
+//* RFC 7541 appendix B, indexed by symbol. 256 is EOS
+constexpr std::array<Code, 257> huffmanCodes{{
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+    {0x3fffffff, 30},
+}};
+
+constexpr std::size_t minCodeLength = 5;
+constexpr std::size_t maxCodeLength = 30;
+
+//* The code is canonical: codes of one length are consecutive and ordered by symbol. So a code can be
+//* decoded by finding its length with a few compares on the next 32 bits instead of walking a tree bit by bit
+struct CanonicalTables
+{
+    std::array<std::uint16_t, 257> symbols{};                //? ordered by (length, symbol)
+    std::array<std::uint64_t, maxCodeLength + 1> limit{};    //? first code past length L, left aligned to 32 bits
+    std::array<std::uint32_t, maxCodeLength + 1> first{};
+    std::array<std::uint16_t, maxCodeLength + 1> offset{};
+};
+
+constexpr CanonicalTables buildCanonicalTables()
+{
+    CanonicalTables tables;
+    std::size_t next = 0;
+    for (std::size_t length = minCodeLength; length <= maxCodeLength; ++length)
+    {
+        tables.offset[length] = static_cast<std::uint16_t>(next);
+        std::uint32_t count = 0;
+        for (std::size_t symbol = 0; symbol < huffmanCodes.size(); ++symbol)
+        {
+            if (huffmanCodes[symbol].length == length)
+            {
+                if (count == 0)
+                {
+                    tables.first[length] = huffmanCodes[symbol].bits;
+                }
+                tables.symbols[next++] = static_cast<std::uint16_t>(symbol);
+                ++count;
+            }
+        }
+        if (count == 0)
+        {
+            //* no code of this length, carry the previous bound so the search skips it
+            tables.first[length] = length == minCodeLength ? 0 : static_cast<std::uint32_t>(tables.limit[length - 1] >> (32 - length));
+        }
+        tables.limit[length] = static_cast<std::uint64_t>(tables.first[length] + count) << (32 - length);
+    }
+    return tables;
+}
+
+constexpr CanonicalTables canonical = buildCanonicalTables();
+static_assert(canonical.limit[maxCodeLength] == (std::uint64_t{1} << 32), "huffman table is not canonical");
+
+constexpr std::array<std::pair<std::string_view, std::string_view>, 61> staticTable{{
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+}};
+
+constexpr std::size_t dynamicBase = staticTable.size() + 1;
+
+void encodeInteger(std::string& out, const std::uint8_t flags, const int prefixBits, std::uint64_t value)
+{
+    const std::uint64_t max = (std::uint64_t{1} << prefixBits) - 1;
+    if (value < max)
+    {
+        out.push_back(static_cast<char>(flags | value));
+        return;
+    }
+    out.push_back(static_cast<char>(flags | max));
+    value -= max;
+    while (value >= 128)
+    {
+        out.push_back(static_cast<char>((value & 127) | 128));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+bool decodeInteger(const std::span<const std::uint8_t> in, std::size_t& pos, const int prefixBits, std::uint64_t& value)
+{
+    if (pos >= in.size())
+    {
+        return false;
+    }
+    const std::uint64_t max = (std::uint64_t{1} << prefixBits) - 1;
+    value = in[pos++] & max;
+    if (value < max)
+    {
+        return true;
+    }
+    for (int shift = 0;; shift += 7)
+    {
+        //* nothing in HTTP/2 needs more than 32 bits, longer encodings are an attack
+        if (pos >= in.size() || shift > 28)
+        {
+            return false;
+        }
+        const std::uint8_t byte = in[pos++];
+        value += static_cast<std::uint64_t>(byte & 127) << shift;
+        if ((byte & 128) == 0)
+        {
+            return true;
+        }
+    }
+}
+
+bool decodeString(const std::span<const std::uint8_t> in, std::size_t& pos, std::string& out)
+{
+    if (pos >= in.size())
+    {
+        return false;
+    }
+    const bool huffman = (in[pos] & 0x80) != 0;
+    std::uint64_t length = 0;
+    if (!decodeInteger(in, pos, 7, length) || length > in.size() - pos)
+    {
+        return false;
+    }
+    const auto data = in.subspan(pos, length);
+    pos += length;
+    out.clear();
+    if (huffman)
+    {
+        return hpack::huffmanDecode(data, out);
+    }
+    out.assign(reinterpret_cast<const char*>(data.data()), data.size());  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    return true;
+}
+
+void encodeString(std::string& out, const std::string_view value)
+{
+    if (const std::size_t packed = hpack::huffmanLength(value); packed < value.size())
+    {
+        encodeInteger(out, 0x80, 7, packed);
+        hpack::huffmanEncode(value, out);
+        return;
+    }
+    encodeInteger(out, 0, 7, value.size());
+    out.append(value);
+}
+}  // namespace
+
+bool hpack::huffmanDecode(const std::span<const std::uint8_t> in, std::string& out)
+{
+    out.reserve(out.size() + in.size() * 8 / 5);
+    std::uint64_t bits = 0;  //? unread bits, left aligned
+    std::size_t available = 0;
+    std::size_t pos = 0;
+    while (true)
+    {
+        while (available <= 56 && pos < in.size())
+        {
+            bits |= static_cast<std::uint64_t>(in[pos++]) << (56 - available);
+            available += 8;
+        }
+        if (available == 0)
+        {
+            return true;
+        }
+        const std::uint64_t next = bits >> 32;
+        std::size_t length = minCodeLength;
+        while (next >= canonical.limit[length])
+        {
+            ++length;
+        }
+        if (length > available)
+        {
+            //* what is left has to be padding: fewer than 8 bits, all of them ones (a prefix of EOS)
+            const std::uint64_t mask = ~std::uint64_t{0} << (64 - available);
+            return available < 8 && (bits & mask) == mask;
+        }
+        const std::uint16_t symbol = canonical.symbols[canonical.offset[length] + ((next >> (32 - length)) - canonical.first[length])];
+        if (symbol == 256)
+        {
+            return false;
+        }
+        out.push_back(static_cast<char>(symbol));
+        bits <<= length;
+        available -= length;
+    }
+}
+
+void hpack::huffmanEncode(const std::string_view in, std::string& out)
+{
+    std::uint64_t bits = 0;
+    std::size_t pending = 0;
+    for (const char c : in)
+    {
+        const Code& code = huffmanCodes[static_cast<unsigned char>(c)];
+        bits = (bits << code.length) | code.bits;
+        pending += code.length;
+        while (pending >= 8)
+        {
+            pending -= 8;
+            out.push_back(static_cast<char>(bits >> pending));
+        }
+    }
+    if (pending > 0)
+    {
+        out.push_back(static_cast<char>((bits << (8 - pending)) | (0xffU >> pending)));
+    }
+}
+
+std::size_t hpack::huffmanLength(const std::string_view in) noexcept
+{
+    std::size_t bits = 0;
+    for (const char c : in)
+    {
+        bits += huffmanCodes[static_cast<unsigned char>(c)].length;
+    }
+    return (bits + 7) / 8;
+}
+
+void hpack::DynamicTable::add(const std::string_view name, const std::string_view value)
+{
+    const std::size_t size = name.size() + value.size() + entryOverhead;
+    if (size > maxSize_)
+    {
+        //* RFC 7541 4.4: an entry bigger than the table empties it
+        entries_.clear();
+        size_ = 0;
+        return;
+    }
+    evict(size);
+    entries_.push_front({std::string(name), std::string(value)});
+    size_ += size;
+}
+
+void hpack::DynamicTable::resize(const std::size_t maxSize)
+{
+    maxSize_ = maxSize;
+    evict(0);
+}
+
+void hpack::DynamicTable::evict(const std::size_t needed)
+{
+    while (!entries_.empty() && size_ + needed > maxSize_)
+    {
+        const HeaderField& oldest = entries_.back();
+        size_ -= oldest.name.size() + oldest.value.size() + entryOverhead;
+        entries_.pop_back();
+    }
+}
+
+hpack::Decoder::Decoder(const std::size_t limit, const std::size_t maxListSize) :
+    table_(limit), limit_(limit), maxListSize_(maxListSize)
+{
+}
+
+const hpack::HeaderField* hpack::Decoder::lookup(const std::uint64_t index) const
+{
+    static const auto statics = [] {
+        std::array<HeaderField, staticTable.size()> fields;
+        for (std::size_t i = 0; i < staticTable.size(); ++i)
+        {
+            fields[i] = {std::string(staticTable[i].first), std::string(staticTable[i].second)};
+        }
+        return fields;
+    }();
+    if (index == 0)
+    {
+        return nullptr;
+    }
+    if (index < dynamicBase)
+    {
+        return &statics[index - 1];
+    }
+    if (index - dynamicBase < table_.count())
+    {
+        return &table_.at(index - dynamicBase);
+    }
+    return nullptr;
+}
+
+bool hpack::Decoder::decode(const std::span<const std::uint8_t> block, std::vector<HeaderField>& out)
+{
+    ZoneScopedN("hpack::decode");  // NOLINT
+    std::size_t pos = 0;
+    std::size_t listSize = 0;
+    bool fieldSeen = false;
+    while (pos < block.size())
+    {
+        const std::uint8_t first = block[pos];
+        std::uint64_t index = 0;
+        if ((first & 0x80) != 0)
+        {
+            //* indexed field
+            const HeaderField* field = nullptr;
+            if (!decodeInteger(block, pos, 7, index) || (field = lookup(index)) == nullptr)
+            {
+                return false;
+            }
+            out.push_back(*field);
+        }
+        else if ((first & 0xe0) == 0x20)
+        {
+            //* table size update, only allowed before the first field of a block
+            if (fieldSeen || !decodeInteger(block, pos, 5, index) || index > limit_)
+            {
+                return false;
+            }
+            table_.resize(index);
+            continue;
+        }
+        else
+        {
+            //* literal, with incremental indexing (01), without (0000) or never indexed (0001)
+            const bool indexing = (first & 0xc0) == 0x40;
+            if (!decodeInteger(block, pos, indexing ? 6 : 4, index))
+            {
+                return false;
+            }
+            HeaderField field;
+            if (index == 0)
+            {
+                if (!decodeString(block, pos, field.name))
+                {
+                    return false;
+                }
+            }
+            else if (const HeaderField* named = lookup(index))
+            {
+                field.name = named->name;
+            }
+            else
+            {
+                return false;
+            }
+            if (!decodeString(block, pos, field.value))
+            {
+                return false;
+            }
+            if (indexing)
+            {
+                table_.add(field.name, field.value);
+            }
+            out.push_back(std::move(field));
+        }
+        fieldSeen = true;
+        listSize += out.back().name.size() + out.back().value.size() + DynamicTable::entryOverhead;
+        if (listSize > maxListSize_)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void hpack::Encoder::setMaxTableSize(const std::size_t size)
+{
+    //* never use more than the default, even when the peer would allow it
+    pendingSize_ = std::min<std::size_t>(size, 4096);
+    sizeUpdatePending_ = pendingSize_ != table_.maxSize();
+}
+
+void hpack::Encoder::encode(std::string& out, const std::string_view name, const std::string_view value)
+{
+    if (sizeUpdatePending_)
+    {
+        encodeInteger(out, 0x20, 5, pendingSize_);
+        table_.resize(pendingSize_);
+        sizeUpdatePending_ = false;
+    }
+
+    std::size_t nameIndex = 0;
+    for (std::size_t i = 0; i < staticTable.size(); ++i)
+    {
+        if (staticTable[i].first == name)
+        {
+            if (staticTable[i].second == value)
+            {
+                encodeInteger(out, 0x80, 7, i + 1);
+                return;
+            }
+            nameIndex = nameIndex == 0 ? i + 1 : nameIndex;
+        }
+    }
+    for (std::size_t i = 0; i < table_.count(); ++i)
+    {
+        if (const HeaderField& field = table_.at(i); field.name == name)
+        {
+            if (field.value == value)
+            {
+                encodeInteger(out, 0x80, 7, dynamicBase + i);
+                return;
+            }
+            nameIndex = nameIndex == 0 ? dynamicBase + i : nameIndex;
+        }
+    }
+
+    const bool index = name != "content-length" && name != "set-cookie" && name != "date";
+    encodeInteger(out, index ? 0x40 : 0x00, index ? 6 : 4, nameIndex);
+    if (nameIndex == 0)
+    {
+        encodeString(out, name);
+    }
+    encodeString(out, value);
+    if (index)
+    {
+        table_.add(name, value);
+    }
+}
@@ -0,0 +1,336 @@
+#include "server/http.hpp"
+#include "server/simd.hpp"
+#include "server/utils.hpp"
+#include "tracy/Tracy.hpp"
+
+#include <charconv>
+#include <stdexcept>
+
+namespace
+{
+constexpr std::size_t maxHeaders = 100;
+
+//* Maps a parsed (lowercase) header name to its fixed slot, Count when it has none.
+//* The switch runs on the precomputed hashes, the string compare only rules out collisions.
+http::Header commonHeader(const std::string_view name, const std::uint64_t hash) noexcept
+{
+    using enum http::Header;
+    const auto is = [&](const std::string_view expected, const http::Header header) {
+        return name == expected ? header : Count;
+    };
+    switch (hash)
+    {
+        case http::hashName("host"):
+            return is("host", Host);
+        case http::hashName("connection"):
+            return is("connection", Connection);
+        case http::hashName("content-length"):
+            return is("content-length", ContentLength);
+        case http::hashName("content-type"):
+            return is("content-type", ContentType);
+        case http::hashName("cookie"):
+            return is("cookie", Cookie);
+        case http::hashName("upgrade"):
+            return is("upgrade", Upgrade);
+        case http::hashName("accept"):
+            return is("accept", Accept);
+        case http::hashName("accept-encoding"):
+            return is("accept-encoding", AcceptEncoding);
+        case http::hashName("authorization"):
+            return is("authorization", Authorization);
+        case http::hashName("user-agent"):
+            return is("user-agent", UserAgent);
+        case http::hashName("transfer-encoding"):
+            return is("transfer-encoding", TransferEncoding);
+        default:
+            return Count;
+    }
+}
+
+//* CR or LF in a header would let a handler that echoes request data start a header (or a whole response) of
+//* its own, NUL is cut off by some clients
+bool safeFieldValue(const std::string_view value) noexcept
+{
+    return value.find_first_of(std::string_view("\r\n\0", 3)) == std::string_view::npos;
+}
+
+void splitParams(std::string_view data, const char separator, http::Params& out)
+{
+    while (!data.empty())
+    {
+        const std::size_t end = simd::findByte(data, separator);
+        const std::string_view part = utils::trimView(data.substr(0, end));
+        if (!part.empty())
+        {
+            const std::size_t eq = simd::findByte(part, '=');
+            if (eq == std::string_view::npos)
+            {
+                out.emplace_back(part, std::string_view{});
+            }
+            else
+            {
+                out.emplace_back(part.substr(0, eq), part.substr(eq + 1));
+            }
+        }
+        if (end == std::string_view::npos)
+        {
+            break;
+        }
+        data.remove_prefix(end + 1);
+    }
+}
+
+std::optional<std::string_view> findParam(const http::Params& params, const std::string_view name)
+{
+    for (const auto& [key, value] : params)
+    {
+        if (key == name)
+        {
+            return value;
+        }
+    }
+    return std::nullopt;
+}
+}  // namespace
+
+bool http::Request::parse(const std::span<char> head)
+{
+    ZoneScopedN("Request::parse");  // NOLINT
+    const std::string_view view(head.data(), head.size());
+    //* one extra slot so a request with too many headers can be told apart
+    std::array<std::uint32_t, maxHeaders + 2> lineEnds{};
+    const std::size_t lines = simd::lineEnds(view, lineEnds);
+    if (lines == 0 || lines == lineEnds.size())
+    {
+        return false;
+    }
+
+    std::string_view requestLine = view.substr(0, lineEnds[0]);
+    const std::size_t methodEnd = simd::findByte(requestLine, ' ');
+    if (methodEnd == std::string_view::npos || !simd::isToken(requestLine.substr(0, methodEnd)))
+    {
+        return false;
+    }
+    const std::string_view method = requestLine.substr(0, methodEnd);
+    requestLine.remove_prefix(methodEnd + 1);
+    const std::size_t targetEnd = simd::findByte(requestLine, ' ');
+    setHead(method, requestLine.substr(0, targetEnd),
+            targetEnd == std::string_view::npos ? std::string_view{} : utils::trimView(requestLine.substr(targetEnd + 1)));
+
+    fields_.reserve(lines - 1);
+    for (std::size_t i = 1; i < lines; ++i)
+    {
+        const std::size_t begin = lineEnds[i - 1] + 2;
+        const std::string_view line = view.substr(begin, lineEnds[i] - begin);
+        const std::size_t colon = simd::findByte(line, ':');
+        if (colon == std::string_view::npos)
+        {
+            continue;
+        }
+        //* RFC 9112: no whitespace between the name and the colon, the name has to be a token
+        if (!simd::isToken(line.substr(0, colon)))
+        {
+            return false;
+        }
+        simd::toLower(head.subspan(begin, colon));
+        addField(line.substr(0, colon), utils::trimView(line.substr(colon + 1)));
+    }
+    return true;
+}
+
+void http::Request::setHead(const std::string_view method, const std::string_view target, const std::string_view version)
+{
+    method_ = method;
+    target_ = target;
+    version_ = version;
+    const std::size_t queryStart = simd::findByte(target_, '?');
+    path_ = target_.substr(0, queryStart);
+    query_ = queryStart == std::string_view::npos ? std::string_view{} : target_.substr(queryStart + 1);
+}
+
+void http::Request::addHeader(const std::string_view name, const std::string_view value)
+{
+    addField(name, value);
+}
+
+void http::Request::addField(const std::string_view name, const std::string_view value)
+{
+    const std::uint64_t hash = hashName(name);
+    fields_.push_back({name, value, hash});
+    //* first one wins for the fixed slots, same as header(name)
+    if (const Header slot = commonHeader(name, hash); slot != Header::Count && common_[static_cast<std::size_t>(slot)].empty())
+    {
+        common_[static_cast<std::size_t>(slot)] = value;
+    }
+}
+
+void http::Request::rebase(const char* oldBase, const char* newBase) noexcept
+{
+    const auto shift = [oldBase, newBase](std::string_view& view) {
+        if (!view.empty())
+        {
+            view = std::string_view(newBase + (view.data() - oldBase), view.size());
+        }
+    };
+    for (std::string_view* view : {&method_, &target_, &path_, &query_, &version_, &body_})
+    {
+        shift(*view);
+    }
+    for (Field& field : fields_)
+    {
+        shift(field.name);
+        shift(field.value);
+    }
+    for (std::string_view& value : common_)
+    {
+        shift(value);
+    }
+}
+
+void http::Request::reset() noexcept
+{
+    method_ = target_ = path_ = query_ = version_ = body_ = {};
+    fields_.clear();
+    common_.fill({});
+    queryParams_.clear();
+    cookies_.clear();
+    queryParsed_ = cookiesParsed_ = false;
+}
+
+std::string_view http::Request::header(const std::string_view name) const noexcept
+{
+    const std::uint64_t hash = hashName(name);
+    for (const Field& field : fields_)
+    {
+        if (field.hash == hash && simd::equalsIgnoreCase(name, field.name))
+        {
+            return field.value;
+        }
+    }
+    return {};
+}
+
+const http::Params& http::Request::queryParams() const
+{
+    if (!queryParsed_)
+    {
+        splitParams(query_, '&', queryParams_);
+        queryParsed_ = true;
+    }
+    return queryParams_;
+}
+
+const http::Params& http::Request::cookies() const
+{
+    if (!cookiesParsed_)
+    {
+        splitParams(header(Header::Cookie), ';', cookies_);
+        cookiesParsed_ = true;
+    }
+    return cookies_;
+}
+
+std::optional<std::string_view> http::Request::queryParam(const std::string_view name) const
+{
+    return findParam(queryParams(), name);
+}
+
+std::optional<std::string_view> http::Request::cookie(const std::string_view name) const
+{
+    return findParam(cookies(), name);
+}
+
+http::Response& http::Response::status(const std::uint16_t code) noexcept
+{
+    status_ = code;
+    return *this;
+}
+
+http::Response& http::Response::header(const std::string_view name, const std::string_view value)
+{
+    if (!simd::isToken(name) || !safeFieldValue(value))
+    {
+        throw std::invalid_argument("Invalid response header: " + std::string(name));
+    }
+    headers_.append(name).append(": ").append(value).append("\r\n");
+    return *this;
+}
+
+http::Response& http::Response::contentType(const std::string_view type)
+{
+    if (!safeFieldValue(type))
+    {
+        throw std::invalid_argument("Invalid content type");
+    }
+    contentType_.assign(type);
+    return *this;
+}
+
+http::Response& http::Response::body(std::string body) noexcept
+{
+    body_ = std::move(body);
+    ownsBody_ = true;
+    return *this;
+}
+
+http::Response& http::Response::staticBody(const std::string_view body) noexcept
+{
+    staticBody_ = body;
+    ownsBody_ = false;
+    return *this;
+}
+
+void http::Response::serializeHead(std::string& out, const bool keepAlive) const
+{
+    std::array<char, 20> length{};
+    const auto [end, ec] = std::to_chars(length.data(), length.data() + length.size(), bodyView().size());
+    std::array<char, 8> code{};
+    const auto [codeEnd, codeEc] = std::to_chars(code.data(), code.data() + code.size(), status_);
+
+    out.append("HTTP/1.1 ").append(code.data(), codeEnd).append(" ").append(reason(status_)).append("\r\n");
+    if (!contentType_.empty())
+    {
+        out.append("Content-Type: ").append(contentType_).append("\r\n");
+    }
+    out.append("Content-Length: ").append(length.data(), end).append("\r\n");
+    out.append("Connection: ").append(keepAlive ? "keep-alive" : "close").append("\r\n");
+    out.append(headers_).append("\r\n");
+}
+
+void http::Response::reset() noexcept
+{
+    status_ = 200;
+    contentType_ = "text/plain";
+    headers_.clear();
+    body_.clear();
+    staticBody_ = {};
+    ownsBody_ = true;
+}
+
+std::string_view http::Response::reason(const std::uint16_t code) noexcept
+{
+    switch (code)
+    {
+        case 100: return "Continue";
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Content Too Large";
+        case 429: return "Too Many Requests";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        default: return "Unknown";
+    }
+}
@@ -0,0 +1,957 @@
+#include "server/http2.hpp"
+#include "server/server.hpp"
+#include "server/simd.hpp"
+#include "server/utils.hpp"
+#include "tracy/Tracy.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <utility>
+
+namespace
+{
+constexpr std::size_t frameHeaderSize = 9;
+constexpr std::size_t readChunk = 16 * 1024;
+constexpr std::size_t maxHeaderBlock = 64 * 1024;
+constexpr std::int64_t maxWindow = 0x7fffffff;
+
+constexpr std::uint8_t flagEndStream = 0x1;
+constexpr std::uint8_t flagAck = 0x1;
+constexpr std::uint8_t flagEndHeaders = 0x4;
+constexpr std::uint8_t flagPadded = 0x8;
+constexpr std::uint8_t flagPriority = 0x20;
+
+constexpr std::uint16_t settingHeaderTableSize = 1;
+constexpr std::uint16_t settingEnablePush = 2;
+constexpr std::uint16_t settingMaxConcurrentStreams = 3;
+constexpr std::uint16_t settingInitialWindowSize = 4;
+constexpr std::uint16_t settingMaxFrameSize = 5;
+constexpr std::uint16_t settingMaxHeaderListSize = 6;
+
+std::uint32_t readU32(const std::span<const std::uint8_t> in)
+{
+    return (static_cast<std::uint32_t>(in[0]) << 24) | (static_cast<std::uint32_t>(in[1]) << 16) |
+           (static_cast<std::uint32_t>(in[2]) << 8) | in[3];
+}
+
+void appendU16(std::string& out, const std::uint16_t value)
+{
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+void appendU32(std::string& out, const std::uint32_t value)
+{
+    appendU16(out, static_cast<std::uint16_t>(value >> 16));
+    appendU16(out, static_cast<std::uint16_t>(value));
+}
+
+void appendFrameHeader(std::string& out, const std::size_t length, const http2::FrameType type, const std::uint8_t flags,
+                       const std::uint32_t streamId)
+{
+    out.push_back(static_cast<char>(length >> 16));
+    appendU16(out, static_cast<std::uint16_t>(length));
+    out.push_back(static_cast<char>(type));
+    out.push_back(static_cast<char>(flags));
+    appendU32(out, streamId);
+}
+
+std::span<const std::uint8_t> bytes(const std::string_view data)
+{
+    return {reinterpret_cast<const std::uint8_t*>(data.data()), data.size()};  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+}
+
+std::string_view chars(const std::span<const std::uint8_t> data)
+{
+    return {reinterpret_cast<const char*>(data.data()), data.size()};  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+}
+
+//* Drops the pad length byte and the padding. false when the padding is longer than the frame
+bool stripPadding(const std::uint8_t flags, std::span<const std::uint8_t>& payload)
+{
+    if ((flags & flagPadded) == 0)
+    {
+        return true;
+    }
+    if (payload.empty() || payload[0] >= payload.size())
+    {
+        return false;
+    }
+    payload = payload.subspan(1, payload.size() - 1 - payload[0]);
+    return true;
+}
+
+//* Hop-by-hop HTTP/1 headers, RFC 9113 8.2.2 forbids them in HTTP/2
+bool isConnectionSpecific(const std::string_view name)
+{
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" || name == "transfer-encoding" ||
+           name == "upgrade" || name == "http2-settings";
+}
+
+//* Comma separated token list, tokens compared case-insensitively. token has to be lowercase
+bool hasToken(std::string_view list, const std::string_view token)
+{
+    while (!list.empty())
+    {
+        const std::size_t comma = simd::findByte(list, ',');
+        if (simd::equalsIgnoreCase(utils::trimView(list.substr(0, comma)), token))
+        {
+            return true;
+        }
+        if (comma == std::string_view::npos)
+        {
+            break;
+        }
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+//* HTTP2-Settings is base64url without padding
+std::string decodeBase64Url(const std::string_view in)
+{
+    const auto value = [](const char c) -> int {
+        if (c >= 'A' && c <= 'Z') { return c - 'A'; }
+        if (c >= 'a' && c <= 'z') { return c - 'a' + 26; }
+        if (c >= '0' && c <= '9') { return c - '0' + 52; }
+        if (c == '-' || c == '+') { return 62; }
+        if (c == '_' || c == '/') { return 63; }
+        return -1;
+    };
+    std::string out;
+    std::uint32_t bits = 0;
+    int count = 0;
+    for (const char c : in)
+    {
+        const int v = value(c);
+        if (v < 0)
+        {
+            break;
+        }
+        bits = (bits << 6) | static_cast<std::uint32_t>(v);
+        count += 6;
+        if (count >= 8)
+        {
+            count -= 8;
+            out.push_back(static_cast<char>(bits >> count));
+        }
+    }
+    return out;
+}
+}  // namespace
+
+bool http2::wantsUpgrade(const http::Request& request)
+{
+    if (request.version() != "HTTP/1.1" || !hasToken(request.header(http::Header::Upgrade), "h2c") ||
+        !hasToken(request.header(http::Header::Connection), "upgrade"))
+    {
+        return false;
+    }
+    return std::ranges::any_of(request.headers(), [](const http::Request::Field& field) { return field.name == "http2-settings"; });
+}
+
+std::string http2::refuseConnection(const ErrorCode code)
+{
+    std::string frames;
+    appendFrameHeader(frames, 0, FrameType::Settings, 0, 0);
+    //* last stream 0, none of the client's streams were processed and all of them can be retried
+    appendFrameHeader(frames, 8, FrameType::GoAway, 0, 0);
+    appendU32(frames, 0);
+    appendU32(frames, static_cast<std::uint32_t>(code));
+    return frames;
+}
+
+http2::Connection::Connection(const int fd, server::Server& server, const server::TcpServer& listener,
+                              const std::string_view clientAddress) :
+    fd_(fd), server_(server), listener_(listener), clientAddress_(clientAddress)
+{
+}
+
+http2::Connection::~Connection() = default;
+
+coro::Task<> http2::Connection::run(std::string received, const http::Request* upgrade)
+{
+    loop_ = &server::EventLoop::current();
+    in_ = std::move(received);
+    if (upgrade != nullptr)
+    {
+        out_.append("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n");
+    }
+    writeSettings();
+    //* everything past the default connection window is granted up front
+    writeWindowUpdate(0, connectionWindow - defaultWindow);
+    if (upgrade != nullptr)
+    {
+        upgradeFrom(*upgrade);
+    }
+
+    bool open = true;
+    while (open && in_.size() < preface.size() && preface.starts_with(in_))
+    {
+        open = co_await readMore();
+    }
+    if (open && !in_.starts_with(preface))
+    {
+        goAway(ErrorCode::ProtocolError);
+    }
+    else if (open)
+    {
+        in_.erase(0, preface.size());
+        while (processFrames() && !(peerGoAway_ && streams_.empty()))
+        {
+            //* a peer that doesn't read can't make us buffer without limit, its frames wait in the socket
+            co_await DrainedOutputAwaiter{*this};
+            if (broken_ || !co_await readMore())
+            {
+                break;
+            }
+        }
+    }
+    //* streams and the flush point back at this connection, it can't go away before them
+    co_await DrainAwaiter{*this};
+}
+
+coro::Task<bool> http2::Connection::readMore()
+{
+    const std::size_t used = in_.size();
+    in_.resize(used + readChunk);
+    const ssize_t n = co_await coro::recvSome(fd_, std::span(in_).subspan(used));
+    in_.resize(used + static_cast<std::size_t>(std::max<ssize_t>(n, 0)));
+    if (n > 0 && onReceive_)
+    {
+        onReceive_(std::string_view(in_).substr(used));
+    }
+    co_return n > 0;
+}
+
+bool http2::Connection::processFrames()
+{
+    ZoneScopedN("http2::processFrames");  // NOLINT
+    std::size_t pos = 0;
+    bool ok = true;
+    while (ok && in_.size() - pos >= frameHeaderSize)
+    {
+        const auto header = bytes(in_).subspan(pos, frameHeaderSize);
+        const std::uint32_t length = (static_cast<std::uint32_t>(header[0]) << 16) | (static_cast<std::uint32_t>(header[1]) << 8) | header[2];
+        if (length > maxFrameSize)
+        {
+            ok = goAway(ErrorCode::FrameSizeError);
+            break;
+        }
+        if (in_.size() - pos - frameHeaderSize < length)
+        {
+            break;
+        }
+        const auto type = static_cast<FrameType>(header[3]);
+        const std::uint32_t streamId = readU32(header.subspan(5)) & 0x7fffffff;
+        ok = handleFrame(type, header[4], streamId, bytes(in_).subspan(pos + frameHeaderSize, length));
+        pos += frameHeaderSize + length;
+        if (ok && queuedControl_ + sendingControl_ > maxQueuedControlFrames)
+        {
+            ok = goAway(ErrorCode::EnhanceYourCalm);
+        }
+    }
+    in_.erase(0, pos);
+    return ok;
+}
+
+bool http2::Connection::handleFrame(const FrameType type, const std::uint8_t flags, const std::uint32_t streamId,
+                                    const std::span<const std::uint8_t> payload)
+{
+    //* the client preface has to end with a SETTINGS frame, and a header block can't be interrupted
+    if ((!settingsReceived_ && type != FrameType::Settings) ||
+        (expectContinuation_ && (type != FrameType::Continuation || streamId != headerStream_)))
+    {
+        return goAway(ErrorCode::ProtocolError);
+    }
+    switch (type)
+    {
+        case FrameType::Data:
+            return handleData(flags, streamId, payload);
+        case FrameType::Headers:
+            return handleHeaders(flags, streamId, payload);
+        case FrameType::Priority:
+            if (streamId == 0)
+            {
+                return goAway(ErrorCode::ProtocolError);
+            }
+            //* priorities are deprecated (RFC 9113 5.3.2), only the size is checked
+            if (payload.size() != 5)
+            {
+                resetStream(streamId, ErrorCode::FrameSizeError);
+                handleReset(streamId);
+            }
+            return true;
+        case FrameType::RstStream:
+            if (streamId == 0 || streamId > lastStreamId_)
+            {
+                return goAway(ErrorCode::ProtocolError);
+            }
+            if (payload.size() != 4)
+            {
+                return goAway(ErrorCode::FrameSizeError);
+            }
+            handleReset(streamId);
+            return true;
+        case FrameType::Settings:
+            return handleSettings(flags, streamId, payload);
+        case FrameType::PushPromise:
+            return goAway(ErrorCode::ProtocolError);
+        case FrameType::Ping:
+            if (streamId != 0)
+            {
+                return goAway(ErrorCode::ProtocolError);
+            }
+            if (payload.size() != 8)
+            {
+                return goAway(ErrorCode::FrameSizeError);
+            }
+            if ((flags & flagAck) == 0)
+            {
+                writeFrame(FrameType::Ping, flagAck, 0, chars(payload));
+            }
+            return true;
+        case FrameType::GoAway:
+            if (streamId != 0)
+            {
+                return goAway(ErrorCode::ProtocolError);
+            }
+            peerGoAway_ = true;
+            return true;
+        case FrameType::WindowUpdate:
+            return handleWindowUpdate(streamId, payload);
+        case FrameType::Continuation:
+            if (!expectContinuation_)
+            {
+                return goAway(ErrorCode::ProtocolError);
+            }
+            headerBlock_.append(chars(payload));
+            if (headerBlock_.size() > maxHeaderBlock)
+            {
+                return goAway(ErrorCode::EnhanceYourCalm);
+            }
+            if ((flags & flagEndHeaders) != 0)
+            {
+                expectContinuation_ = false;
+                return finishHeaders();
+            }
+            return true;
+        default:
+            //* unknown frame types are ignored (RFC 9113 4.1)
+            return true;
+    }
+}
+
+bool http2::Connection::handleHeaders(const std::uint8_t flags, const std::uint32_t streamId, std::span<const std::uint8_t> payload)
+{
+    if (streamId == 0 || streamId % 2 == 0 || !stripPadding(flags, payload))
+    {
+        return goAway(ErrorCode::ProtocolError);
+    }
+    if ((flags & flagPriority) != 0)
+    {
+        if (payload.size() < 5)
+        {
+            return goAway(ErrorCode::FrameSizeError);
+        }
+        payload = payload.subspan(5);
+    }
+    headerBlock_.assign(chars(payload));
+    headerStream_ = streamId;
+    headerFlags_ = flags;
+    if ((flags & flagEndHeaders) == 0)
+    {
+        expectContinuation_ = true;
+        return true;
+    }
+    return finishHeaders();
+}
+
+bool http2::Connection::finishHeaders()
+{
+    //* every block has to be decoded, even for streams we refuse, or the table gets out of sync
+    decoded_.clear();
+    if (!decoder_.decode(bytes(headerBlock_), decoded_))
+    {
+        return goAway(ErrorCode::CompressionError);
+    }
+    //* the client may have sent trailers before our RST_STREAM reached it, they are dropped (RFC 9113 5.4.2)
+    if (wasReset(headerStream_))
+    {
+        return true;
+    }
+    const bool endStream = (headerFlags_ & flagEndStream) != 0;
+
+    if (const auto it = streams_.find(headerStream_); it != streams_.end())
+    {
+        //* trailers, nothing looks at them but they end the request
+        Stream& stream = *it->second;
+        if (stream.remoteClosed || !endStream)
+        {
+            return goAway(ErrorCode::ProtocolError);
+        }
+        stream.remoteClosed = true;
+        start(stream);
+        return true;
+    }
+    if (headerStream_ <= lastStreamId_)
+    {
+        return goAway(ErrorCode::StreamClosed);
+    }
+    lastStreamId_ = headerStream_;
+    if (goAwaySent_)
+    {
+        return true;
+    }
+    if (streams_.size() >= maxConcurrentStreams)
+    {
+        resetStream(headerStream_, ErrorCode::RefusedStream);
+        return true;
+    }
+
+    auto stream = std::make_unique<Stream>();
+    stream->id = headerStream_;
+    stream->sendWindow = peerInitialWindow_;
+    stream->fields.swap(decoded_);
+    if (!buildRequest(*stream))
+    {
+        resetStream(headerStream_, ErrorCode::ProtocolError);
+        return true;
+    }
+    Stream& started = *streams_.emplace(headerStream_, std::move(stream)).first->second;
+    if (endStream)
+    {
+        started.remoteClosed = true;
+        start(started);
+    }
+    return true;
+}
+
+bool http2::Connection::handleData(const std::uint8_t flags, const std::uint32_t streamId, std::span<const std::uint8_t> payload)
+{
+    if (streamId == 0)
+    {
+        return goAway(ErrorCode::ProtocolError);
+    }
+    //* padding counts against flow control too
+    const auto length = static_cast<std::int64_t>(payload.size());
+    if (length > receiveWindow_)
+    {
+        return goAway(ErrorCode::FlowControlError);
+    }
+    receiveWindow_ -= length;
+    if (receiveWindow_ < connectionWindow / 2)
+    {
+        writeWindowUpdate(0, static_cast<std::uint32_t>(connectionWindow - receiveWindow_));
+        receiveWindow_ = connectionWindow;
+    }
+    if (!stripPadding(flags, payload))
+    {
+        return goAway(ErrorCode::ProtocolError);
+    }
+    //* body still in flight on a stream we reset, it only had to count against the connection window
+    if (wasReset(streamId))
+    {
+        return true;
+    }
+
+    const auto it = streams_.find(streamId);
+    if (it == streams_.end())
+    {
+        if (streamId > lastStreamId_)
+        {
+            return goAway(ErrorCode::ProtocolError);
+        }
+        resetStream(streamId, ErrorCode::StreamClosed);
+        return true;
+    }
+    Stream& stream = *it->second;
+    //* stream windows are never topped up, so a request body can't get past the initial window (64 KiB)
+    stream.receiveWindow -= length;
+    if (stream.remoteClosed || stream.receiveWindow < 0)
+    {
+        resetStream(streamId, stream.remoteClosed ? ErrorCode::StreamClosed : ErrorCode::FlowControlError);
+        handleReset(streamId);
+        return true;
+    }
+    stream.body.append(chars(payload));
+    if ((flags & flagEndStream) != 0)
+    {
+        stream.remoteClosed = true;
+        start(stream);
+    }
+    else if (stream.receiveWindow == 0)
+    {
+        //* the window is used up and the body isn't complete, the client would wait forever.
+        //* Answer now and tell it to stop sending (RFC 9113 8.1)
+        stream.response.status(413);
+        respond(stream);
+        resetStream(streamId, ErrorCode::NoError);
+    }
+    return true;
+}
+
+bool http2::Connection::handleSettings(const std::uint8_t flags, const std::uint32_t streamId, const std::span<const std::uint8_t> payload)
+{
+    if (streamId != 0)
+    {
+        return goAway(ErrorCode::ProtocolError);
+    }
+    if ((flags & flagAck) != 0)
+    {
+        return payload.empty() || goAway(ErrorCode::FrameSizeError);
+    }
+    if (payload.size() % 6 != 0)
+    {
+        return goAway(ErrorCode::FrameSizeError);
+    }
+    for (std::size_t i = 0; i < payload.size(); i += 6)
+    {
+        const auto id = static_cast<std::uint16_t>((payload[i] << 8) | payload[i + 1]);
+        if (!applySetting(id, readU32(payload.subspan(i + 2))))
+        {
+            return false;
+        }
+    }
+    settingsReceived_ = true;
+    writeFrame(FrameType::Settings, flagAck, 0, {});
+    //* a bigger initial window may unblock streams
+    pump();
+    return true;
+}
+
+bool http2::Connection::applySetting(const std::uint16_t id, const std::uint32_t value)
+{
+    switch (id)
+    {
+        case settingHeaderTableSize:
+            encoder_.setMaxTableSize(value);
+            return true;
+        case settingEnablePush:
+            return value <= 1 || goAway(ErrorCode::ProtocolError);
+        case settingInitialWindowSize:
+        {
+            if (value > maxWindow)
+            {
+                return goAway(ErrorCode::FlowControlError);
+            }
+            //* the change applies to every open stream (RFC 9113 6.9.2)
+            const std::int64_t delta = static_cast<std::int64_t>(value) - peerInitialWindow_;
+            for (const auto& [streamId, stream] : streams_)
+            {
+                stream->sendWindow += delta;
+                if (stream->sendWindow > maxWindow)
+                {
+                    return goAway(ErrorCode::FlowControlError);
+                }
+            }
+            peerInitialWindow_ = value;
+            return true;
+        }
+        case settingMaxFrameSize:
+            if (value < maxFrameSize || value > 0xffffff)
+            {
+                return goAway(ErrorCode::ProtocolError);
+            }
+            peerMaxFrameSize_ = value;
+            return true;
+        default:
+            return true;
+    }
+}
+
+bool http2::Connection::handleWindowUpdate(const std::uint32_t streamId, const std::span<const std::uint8_t> payload)
+{
+    if (payload.size() != 4)
+    {
+        return goAway(ErrorCode::FrameSizeError);
+    }
+    const std::uint32_t increment = readU32(payload) & 0x7fffffff;
+    if (streamId == 0)
+    {
+        sendWindow_ += increment;
+        if (increment == 0 || sendWindow_ > maxWindow)
+        {
+            return goAway(increment == 0 ? ErrorCode::ProtocolError : ErrorCode::FlowControlError);
+        }
+    }
+    else
+    {
+        const auto it = streams_.find(streamId);
+        if (it == streams_.end())
+        {
+            //* fine for streams that closed already
+            return streamId <= lastStreamId_ || goAway(ErrorCode::ProtocolError);
+        }
+        Stream& stream = *it->second;
+        stream.sendWindow += increment;
+        if (increment == 0 || stream.sendWindow > maxWindow)
+        {
+            resetStream(streamId, increment == 0 ? ErrorCode::ProtocolError : ErrorCode::FlowControlError);
+            handleReset(streamId);
+            return true;
+        }
+    }
+    pump();
+    return true;
+}
+
+void http2::Connection::handleReset(const std::uint32_t streamId)
+{
+    const auto it = streams_.find(streamId);
+    if (it == streams_.end())
+    {
+        return;
+    }
+    Stream& stream = *it->second;
+    stream.reset = true;
+    std::erase(sendQueue_, &stream);
+    //* a running handler still uses the stream, serve() drops it when the handler is done
+    if (!stream.running)
+    {
+        streams_.erase(it);
+    }
+}
+
+bool http2::Connection::buildRequest(Stream& stream)
+{
+    std::string_view method;
+    std::string_view path;
+    std::string_view authority;
+    bool regular = false;
+    for (const hpack::HeaderField& field : stream.fields)
+    {
+        if (field.name.starts_with(':'))
+        {
+            //* pseudo headers come first (RFC 9113 8.3)
+            if (regular)
+            {
+                return false;
+            }
+            if (field.name == ":method") { method = field.value; }
+            else if (field.name == ":path") { path = field.value; }
+            else if (field.name == ":authority") { authority = field.value; }
+            else if (field.name != ":scheme") { return false; }
+            continue;
+        }
+        regular = true;
+        if (std::ranges::any_of(field.name, [](const char c) { return c >= 'A' && c <= 'Z'; }) || isConnectionSpecific(field.name))
+        {
+            return false;
+        }
+        //* HTTP/2 clients may split cookies into one field per pair, handlers expect one header
+        if (field.name == "cookie")
+        {
+            stream.cookies.append(stream.cookies.empty() ? "" : "; ").append(field.value);
+            continue;
+        }
+        stream.request.addHeader(field.name, field.value);
+    }
+    if (method.empty() || path.empty())
+    {
+        return false;
+    }
+    if (!stream.cookies.empty())
+    {
+        stream.request.addHeader("cookie", stream.cookies);
+    }
+    if (!authority.empty() && stream.request.header(http::Header::Host).empty())
+    {
+        stream.request.addHeader("host", authority);
+    }
+    stream.request.setHead(method, path, "HTTP/2");
+    return true;
+}
+
+void http2::Connection::upgradeFrom(const http::Request& request)
+{
+    for (const http::Request::Field& field : request.headers())
+    {
+        if (field.name == "http2-settings")
+        {
+            //* the 101 acknowledges these, no SETTINGS ACK for them (RFC 7540 3.2.1)
+            const std::string settings = decodeBase64Url(field.value);
+            for (std::size_t i = 0; i + 6 <= settings.size(); i += 6)
+            {
+                const auto setting = bytes(settings).subspan(i);
+                applySetting(static_cast<std::uint16_t>((setting[0] << 8) | setting[1]), readU32(setting.subspan(2)));
+            }
+        }
+    }
+
+    //* the upgraded request is stream 1, already half closed since the whole request has been read
+    auto stream = std::make_unique<Stream>();
+    stream->id = 1;
+    stream->sendWindow = peerInitialWindow_;
+    stream->fields.push_back({":method", std::string(request.method())});
+    stream->fields.push_back({":path", std::string(request.target())});
+    for (const http::Request::Field& field : request.headers())
+    {
+        if (!isConnectionSpecific(field.name))
+        {
+            stream->fields.push_back({std::string(field.name), std::string(field.value)});
+        }
+    }
+    stream->body.assign(request.body());
+    lastStreamId_ = 1;
+    if (!buildRequest(*stream))
+    {
+        resetStream(1, ErrorCode::ProtocolError);
+        return;
+    }
+    Stream& started = *streams_.emplace(1, std::move(stream)).first->second;
+    started.remoteClosed = true;
+    start(started);
+}
+
+void http2::Connection::start(Stream& stream)
+{
+    stream.request.setBody(stream.body);
+    stream.running = true;
+    ++tasks_;
+    loop_->spawn(serve(&stream));
+}
+
+coro::Task<> http2::Connection::serve(Stream* stream)
+{
+    //* route() turns every error into a response, nothing escapes that would skip taskFinished
+    stream->request.setClientAddress(clientAddress_);
+    co_await server_.route(listener_, stream->request, stream->response);
+
+    stream->running = false;
+    if (stream->reset || broken_)
+    {
+        streams_.erase(stream->id);
+    }
+    else
+    {
+        respond(*stream);
+    }
+    taskFinished();
+}
+
+void http2::Connection::respond(Stream& stream)
+{
+    ZoneScopedN("http2::respond");  // NOLINT
+    const http::Response& response = stream.response;
+    std::string block;
+
+    std::array<char, 20> number{};
+    const auto status = std::to_chars(number.data(), number.data() + number.size(), response.statusCode());
+    encoder_.encode(block, ":status", std::string_view(number.data(), status.ptr));
+    if (!response.contentTypeView().empty())
+    {
+        encoder_.encode(block, "content-type", response.contentTypeView());
+    }
+    const auto length = std::to_chars(number.data(), number.data() + number.size(), response.bodyView().size());
+    encoder_.encode(block, "content-length", std::string_view(number.data(), length.ptr));
+
+    std::string_view lines = response.headerLines();
+    std::string name;
+    while (!lines.empty())
+    {
+        const std::size_t eol = lines.find("\r\n");
+        const std::string_view line = lines.substr(0, eol);
+        lines.remove_prefix(eol == std::string_view::npos ? lines.size() : eol + 2);
+        const std::size_t colon = simd::findByte(line, ':');
+        if (colon == std::string_view::npos)
+        {
+            continue;
+        }
+        //* HTTP/2 field names are lowercase
+        name.assign(line.substr(0, colon));
+        simd::toLower(name);
+        if (!isConnectionSpecific(name))
+        {
+            encoder_.encode(block, name, utils::trimView(line.substr(colon + 1)));
+        }
+    }
+
+    stream.unsent = response.bodyView();
+    const bool endStream = stream.unsent.empty();
+    //* the block is split into CONTINUATION frames past the peer's frame size, they have to stay back to back
+    std::string_view rest = block;
+    FrameType type = FrameType::Headers;
+    std::uint8_t flags = endStream ? flagEndStream : 0;
+    do
+    {
+        const std::string_view fragment = rest.substr(0, peerMaxFrameSize_);
+        rest.remove_prefix(fragment.size());
+        writeFrame(type, static_cast<std::uint8_t>(flags | (rest.empty() ? flagEndHeaders : 0)), stream.id, fragment);
+        type = FrameType::Continuation;
+        flags = 0;
+    } while (!rest.empty());
+
+    if (endStream)
+    {
+        close(stream);
+        return;
+    }
+    sendQueue_.push_back(&stream);
+    pump();
+}
+
+void http2::Connection::pump()
+{
+    ZoneScopedN("http2::pump");  // NOLINT
+    bool progress = true;
+    while (progress && sendWindow_ > 0 && !sendQueue_.empty() && !backlogged())
+    {
+        progress = false;
+        //* one frame per stream and round, so one big body can't starve the others
+        for (std::size_t i = 0; i < sendQueue_.size() && sendWindow_ > 0 && !backlogged();)
+        {
+            Stream& stream = *sendQueue_[i];
+            const std::size_t size = std::min({stream.unsent.size(), peerMaxFrameSize_, static_cast<std::size_t>(sendWindow_),
+                                               static_cast<std::size_t>(std::max<std::int64_t>(stream.sendWindow, 0))});
+            if (size == 0)
+            {
+                ++i;
+                continue;
+            }
+            const bool last = size == stream.unsent.size();
+            writeFrame(FrameType::Data, last ? flagEndStream : 0, stream.id, stream.unsent.substr(0, size));
+            stream.unsent.remove_prefix(size);
+            sendWindow_ -= static_cast<std::int64_t>(size);
+            stream.sendWindow -= static_cast<std::int64_t>(size);
+            progress = true;
+            if (last)
+            {
+                sendQueue_.erase(sendQueue_.begin() + static_cast<std::ptrdiff_t>(i));
+                close(stream);
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+}
+
+void http2::Connection::close(Stream& stream)
+{
+    streams_.erase(stream.id);
+}
+
+void http2::Connection::writeFrameHeader(const std::size_t length, const FrameType type, const std::uint8_t flags,
+                                         const std::uint32_t streamId)
+{
+    appendFrameHeader(out_, length, type, flags, streamId);
+}
+
+void http2::Connection::writeFrame(const FrameType type, const std::uint8_t flags, const std::uint32_t streamId,
+                                   const std::string_view payload)
+{
+    writeFrameHeader(payload.size(), type, flags, streamId);
+    out_.append(payload);
+    if (type == FrameType::Ping || type == FrameType::Settings || type == FrameType::RstStream)
+    {
+        ++queuedControl_;
+    }
+    scheduleFlush();
+}
+
+void http2::Connection::writeSettings()
+{
+    std::string payload;
+    appendU16(payload, settingMaxConcurrentStreams);
+    appendU32(payload, maxConcurrentStreams);
+    appendU16(payload, settingMaxHeaderListSize);
+    appendU32(payload, maxHeaderBlock);
+    writeFrame(FrameType::Settings, 0, 0, payload);
+}
+
+void http2::Connection::writeWindowUpdate(const std::uint32_t streamId, const std::uint32_t increment)
+{
+    std::string payload;
+    appendU32(payload, increment);
+    writeFrame(FrameType::WindowUpdate, 0, streamId, payload);
+}
+
+void http2::Connection::resetStream(const std::uint32_t streamId, const ErrorCode code)
+{
+    std::string payload;
+    appendU32(payload, static_cast<std::uint32_t>(code));
+    writeFrame(FrameType::RstStream, 0, streamId, payload);
+    if (!wasReset(streamId))
+    {
+        if (recentlyReset_.size() == maxConcurrentStreams)
+        {
+            recentlyReset_.pop_front();
+        }
+        recentlyReset_.push_back(streamId);
+    }
+}
+
+bool http2::Connection::wasReset(const std::uint32_t streamId) const
+{
+    return std::ranges::find(recentlyReset_, streamId) != recentlyReset_.end();
+}
+
+bool http2::Connection::goAway(const ErrorCode code)
+{
+    if (!goAwaySent_)
+    {
+        std::string payload;
+        appendU32(payload, lastStreamId_);
+        appendU32(payload, static_cast<std::uint32_t>(code));
+        writeFrame(FrameType::GoAway, 0, 0, payload);
+        goAwaySent_ = true;
+    }
+    return false;
+}
+
+void http2::Connection::scheduleFlush()
+{
+    if (broken_)
+    {
+        out_.clear();
+        queuedControl_ = 0;
+        return;
+    }
+    //* the flush runs on the next loop iteration, everything written until then goes out in one send
+    if (!flushing_)
+    {
+        flushing_ = true;
+        ++tasks_;
+        loop_->spawn(flush());
+    }
+}
+
+coro::Task<> http2::Connection::flush()
+{
+    while (!out_.empty() && !broken_)
+    {
+        sending_.swap(out_);
+        sendingControl_ = std::exchange(queuedControl_, 0);
+        broken_ = !co_await coro::sendAll(fd_, sending_);
+        sending_.clear();
+        sendingControl_ = 0;
+        //* bodies held back while the output was backlogged
+        if (!broken_)
+        {
+            pump();
+        }
+        if (reader_ && (broken_ || !backlogged()))
+        {
+            loop_->post(std::exchange(reader_, {}));
+        }
+    }
+    out_.clear();
+    queuedControl_ = 0;
+    flushing_ = false;
+    if (reader_)
+    {
+        loop_->post(std::exchange(reader_, {}));
+    }
+    taskFinished();
+}
+
+void http2::Connection::taskFinished()
+{
+    if (--tasks_ == 0 && drained_)
+    {
+        loop_->post(std::exchange(drained_, {}));
+    }
+}
@@ -1,5 +1,8 @@
 #include "server/server.hpp"
+#include "server/event_loop.hpp"
 #include "server/exceptions.hpp"
+#include "server/http2.hpp"
+#include "server/simd.hpp"
 #include "server/utils.hpp"
 #include "tracy/Tracy.hpp"
 
@@ -7,85 +10,65 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <mutex>
+#include <span>
 #include <stdexcept>
+#include <string>
 #include <thread>
 
-static router::RequestType toRequestType(const std::string& requestT) {
+router::RequestType router::toRequestType(const std::string_view requestT) {
     using enum router::RequestType;
     if (requestT == "GET")    {return GET;}
     if (requestT == "POST")   {return POST;}
     if (requestT == "PUT")    {return PUT;}
     if (requestT == "DELETE") {return DELETE;}
-    throw std::invalid_argument("Invalid request type: " + requestT);
+    throw std::invalid_argument("Invalid request type: " + std::string(requestT));
 }
 
-
-std::unique_ptr<router::RequestHandler>
-router::RequestHandlerFactory::createHandler(const RequestType type) {
-    switch (type) {
-        using enum RequestType;
-        case GET:    return std::make_unique<GETHandler>();
-        case POST:   return std::make_unique<POSTHandler>();
-        case PUT:    return std::make_unique<PUTHandler>();
-        case DELETE: return std::make_unique<DELETEHandler>();
-    }
-    throw std::invalid_argument("Unsupported request type");
-}
-
-
-std::string router::GETHandler::handler(const std::string& path,const std::string&body){
-    return "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n\r\nGET: " + path + "\n" + body;
-}
-router::RequestType router::GETHandler::getType() const { return RequestType::GET; }
-
-std::string router::PUTHandler::handler(const std::string& path, const std::string& body) {
-    return "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n\r\nPUT: " + path + "\n" + body;
-}
-
-router::RequestType router::PUTHandler::getType() const {
-    return RequestType::PUT;
-}
-
-std::string router::POSTHandler::handler(const std::string& path, const std::string& body) {
-    return "HTTP/1.1 201 Created\r\nContent-Type: text/plain\r\n\r\nPOST Body: " + body + "\r\n" + path;
-}
-
-router::RequestType router::POSTHandler::getType() const {
-    return RequestType::POST;
-}
-
-std::string router::DELETEHandler::handler(const std::string& path, const std::string& body) {
-    return "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n\r\nDELETE: " + path + "\r\n" + body;
-}
-
-router::RequestType router::DELETEHandler::getType() const {
-    return RequestType::DELETE;
-}
-
-
-
-void router::Router::addRoute(RequestType type, const std::string& path, RouteHandler handler) {
-    routes_[{type, path}] = std::move(handler);
+namespace
+{
+constexpr std::size_t maxRequestSize = 64 * 1024;
+constexpr std::size_t readChunk = 4096;
+constexpr auto acceptRetryDelay = std::chrono::milliseconds(50);
+//* time a client gets to send a complete request, counted from when we start waiting for it. Covers idle
+//* keep-alive connections too, so a client that sends nothing or trickles bytes can't hold a connection forever
+constexpr auto requestTimeout = std::chrono::seconds(10);
+}  // namespace
+
+void router::Router::insert(RequestType type, std::string_view path, Route route) {
+    auto& routes = routes_[std::to_underlying(type)];
+    routes.insert_or_assign(std::string(path), std::move(route));
 }
 
-router::RouteHandler router::Router::getHandler(RequestType type, const std::string& path) const {
-    auto it = routes_.find({type, path});
-    return it != routes_.end() ? it->second : nullptr;
+const router::Route* router::Router::getHandler(RequestType type, std::string_view path) const {
+    const auto& routes = routes_[std::to_underlying(type)];
+    auto it = routes.find(path);
+    return it != routes.end() ? &it->second : nullptr;
 }
 
 
-server::TcpServer::TcpServer(uint16_t port, router::Router& router)
-  : serverFd_(::socket(AF_INET, SOCK_STREAM, 0)), router_(router)
+namespace
+{
+int bindSocket(const uint16_t port, const bool reusePort)
 {
-    if (serverFd_ < 0)
+    const int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
     {
         throw exceptions::SocketCreationException("Could not create socket");
     }
 
-    if (constexpr int reuse = 1; setsockopt(serverFd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0)
+    constexpr int reuse = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0
+        || (reusePort && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0))
     {
+        ::close(fd);
         throw exceptions::SocketOptionSet("Setsockopt failed");
     }
 
@@ -94,91 +77,276 @@ server::TcpServer::TcpServer(uint16_t port, router::Router& router)
     addr.sin_addr.s_addr = INADDR_ANY;
     addr.sin_port        = htons(port);
 
-    if (bind(serverFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
     {
-        throw exceptions::BindException("Socket bind failed");
+        ::close(fd);
+        throw exceptions::BindException("Socket bind failed, is port " + std::to_string(port) + " already in use?");
     }
+    return fd;
+}
 
-    if (listen(serverFd_, 5) != 0)
+//* Every loop gets its own SO_REUSEPORT socket and the kernel balances accepts between them. The catch is that
+//* a second server started by the same user would join the group silently and steal half the connections, so
+//* a plain socket (no SO_REUSEPORT) is bound first. It fails while anybody is listening on the port
+void ensurePortFree(const uint16_t port)
+{
+    ::close(bindSocket(port, false));
+}
+
+int openListeningSocket(const uint16_t port)
+{
+    const int fd = bindSocket(port, true);
+
+    //* with coroutines we can have thousands of connections in flight, don't drop them at the door
+    if (listen(fd, SOMAXCONN) != 0)
     {
+        ::close(fd);
         throw exceptions::ListenException("listen failed");
     }
+    return fd;
 }
 
-server::TcpServer::~TcpServer() {
+std::string normalizeHost(std::string_view host)
+{
+    //* "Example.com:4222" and "example.com" are the same virtual host, and so are "[::1]:4222" and "[::1]"
+    if (host.starts_with('['))
     {
-        std::lock_guard const lock(clientQueueMutex_);
-        stop_ = true;
+        //* the colons inside an IPv6 literal aren't a port, only what follows the closing bracket is
+        if (const auto bracket = host.find(']'); bracket != std::string_view::npos)
+        {
+            host = host.substr(0, bracket + 1);
+        }
     }
-    clientQueueCond_.notify_all();
-    for (std::thread &t : workerThreads_)
+    else if (const auto colon = host.rfind(':'); colon != std::string_view::npos)
     {
-        if (t.joinable())
-        {
-            t.join();
+        host = host.substr(0, colon);
+    }
+    std::string key(host);
+    std::ranges::transform(key, key.begin(), [](const unsigned char c) { return std::tolower(c); });
+    return key;
+}
+
+//* Repeated Content-Length headers are only fine when they all agree, otherwise the body length is ambiguous
+bool conflictingContentLength(const http::Request& request)
+{
+    const std::string_view first = request.header(http::Header::ContentLength);
+    return std::ranges::any_of(request.headers(), [first](const http::Request::Field& field) {
+        return field.name == "content-length" && field.value != first;
+    });
+}
+}  // namespace
+
+server::TcpServer::TcpServer(uint16_t port, router::Router& router, std::size_t sockets)
+  : port_(port), router_(router)
+{
+    ensurePortFree(port);
+    serverFds_.reserve(sockets);
+    try {
+        for (std::size_t i = 0; i < std::max<std::size_t>(sockets, 1); ++i) {
+            serverFds_.push_back(openListeningSocket(port));
+        }
+    } catch (...) {
+        for (const int fd : serverFds_) {
+            ::close(fd);
         }
+        throw;
+    }
+}
+
+server::TcpServer::~TcpServer() {
+    for (const int fd : serverFds_) {
+        ::close(fd);
     }
-    if (serverFd_ >= 0) { ::close(serverFd_);
 }
+
+server::TcpServer& server::TcpServer::addVirtualHost(std::string_view host, router::Router& router)
+{
+    virtualHosts_[normalizeHost(host)] = &router;
+    return *this;
 }
 
-server::TcpServer::TcpServer(TcpServer&& other) noexcept
-  : serverFd_(other.serverFd_), router_(other.router_)
+router::Router* server::TcpServer::virtualHost(std::string_view host) const
 {
-    other.serverFd_ = -1;
+    const auto it = virtualHosts_.find(host);
+    return it != virtualHosts_.end() ? it->second : nullptr;
 }
 
-server::TcpServer& server::TcpServer::operator=(TcpServer&& other) noexcept {
-    if (this != &other) {
-        if (serverFd_ >= 0)
-        {
-            ::close(serverFd_);
-        }
+server::Server::Server(std::size_t loops, std::size_t workers) : workers_(workers)
+{
+    loops_.reserve(loops);
+    for (std::size_t i = 0; i < std::max<std::size_t>(loops, 1); ++i) {
+        loops_.push_back(std::make_unique<EventLoop>(workers_));
+    }
+}
 
-        serverFd_      = other.serverFd_;
-        router_        = other.router_;
-        other.serverFd_= -1;
+server::Server::~Server()
+{
+    stop();
+    for (std::thread& t : loopThreads_) {
+        if (t.joinable()) {
+            t.join();
+        }
     }
+}
+
+server::TcpServer& server::Server::listen(uint16_t port, router::Router& router)
+{
+    listeners_.push_back(std::make_unique<TcpServer>(port, router, loops_.size()));
+    return *listeners_.back();
+}
+
+server::Server& server::Server::addVirtualHost(std::string_view host, router::Router& router)
+{
+    virtualHosts_[normalizeHost(host)] = &router;
+    return *this;
+}
+
+server::Server& server::Server::enableCapture(const std::string& path)
+{
+    capture_ = std::make_unique<TrafficCapture>(path);
     return *this;
 }
 
-auto server::TcpServer::run() -> void
+server::Server& server::Server::rateLimit(const bool enabled)
+{
+    rateLimit_ = enabled;
+    return *this;
+}
+
+auto server::Server::run() -> void
 {
     ZoneScoped; //NOLINT
-    //* Setting the number of dispatcher threads
-    constexpr int numWorkers = 4;
-    for (int i = 0; i < numWorkers; ++i) {
-        workerThreads_.emplace_back([this] { this->workerLoop(); });
+    for (std::size_t i = 0; i < loops_.size(); ++i) {
+        for (const std::unique_ptr<TcpServer>& listener : listeners_) {
+            loops_[i]->spawn(acceptLoop(*listener, listener->fd(i)));
+        }
+    }
+
+    for (std::size_t i = 1; i < loops_.size(); ++i) {
+        loopThreads_.emplace_back([this, i] {
+            tracy::SetThreadName("EventLoop");
+            loops_[i]->run();
+        });
+    }
+    {
+        const std::lock_guard lock(loggingMutex_);
+        std::cout << "[SERVER] " << listeners_.size() << " listeners on " << loops_.size() << " loops, "
+                  << workers_.size() << " workers\n";
     }
+    loops_.front()->run();
+}
 
+void server::Server::stop()
+{
+    for (const std::unique_ptr<EventLoop>& loop : loops_) {
+        loop->stop();
+    }
+}
+
+coro::Task<> server::Server::acceptLoop(TcpServer& listener, const int serverFd)
+{
+    EventLoop& loop = EventLoop::current();
     while (true) {
-        ZoneScopedN("AcceptConnection"); //NOLINT
-        sockaddr_in clientAddr{};
-        socklen_t len = sizeof(clientAddr);
-        int const fd = accept(serverFd_, reinterpret_cast<sockaddr*>(&clientAddr), &len);
-        if (fd < 0)
+        co_await loop.readable(serverFd);
+        //* drain the backlog, every accepted socket becomes its own coroutine on this loop
+        int error = 0;
+        while (true) {
+            ZoneScopedN("AcceptConnection"); //NOLINT
+            sockaddr_in clientAddr{};
+            socklen_t len = sizeof(clientAddr);
+            int const fd = ::accept4(serverFd, reinterpret_cast<sockaddr*>(&clientAddr), &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                error = errno;
+                if (error == EINTR || error == ECONNABORTED)
+                {
+                    continue;
+                }
+                break;
+            }
+            loop.spawn(handleClient(listener, fd));
+        }
+        //* out of fds (EMFILE, ENFILE) or memory the backlog stays readable, re-arming right away would spin.
+        //* Give the open connections some time to finish first
+        if (error != EAGAIN && error != EWOULDBLOCK)
         {
-            continue;
+            co_await coro::sleepFor(acceptRetryDelay);
         }
+    }
+}
+
+router::Router& server::Server::routerFor(const TcpServer& listener, const http::Request& request) const
+{
+    const std::string_view hostHeader = request.header(http::Header::Host);
+    //* most deployments have no virtual hosts, skip normalizing the header for them
+    if (hostHeader.empty() || (virtualHosts_.empty() && !listener.hasVirtualHosts())) {
+        return listener.defaultRouter();
+    }
+    const std::string host = normalizeHost(hostHeader);
+    if (router::Router* router = listener.virtualHost(host)) {
+        return *router;
+    }
+    if (const auto vhost = virtualHosts_.find(host); vhost != virtualHosts_.end()) {
+        return *vhost->second;
+    }
+    return listener.defaultRouter();
+}
+
+//* Tracy zones have to open and close in order on one thread, so in the coroutines below they only wrap
+//* code that doesn't suspend. Time spent waiting on the socket or on an async handler isn't a zone
+coro::Task<> server::Server::route(const TcpServer& listener, const http::Request& request, http::Response& response)
+{
+    router::RequestType type{};
+    try {
+        type = router::toRequestType(request.method());
+    } catch (const std::invalid_argument&) {
+        response.status(501);
+        co_return;
+    }
+
+    //* the only place request errors are caught, for HTTP/1 and HTTP/2 alike. Whatever is thrown the client
+    //* gets a 500 and the caller carries on, HTTP/2 streams rely on route() never throwing
+    //* co_await isn't allowed inside a catch block, the error response is built after it
+    bool failed = false;
+    try {
+        const router::Route* route = nullptr;
         {
-            ZoneScopedN("QueueClient"); //NOLINT
-            const std::lock_guard lock(clientQueueMutex_);
-            clientQueue_.push(fd);
+            ZoneScopedN("FindRoute"); //NOLINT
+            route = routerFor(listener, request).getHandler(type, request.path());
+        }
+        if (route == nullptr) {
+            response.status(404).staticBody("Route not found");
+        } else if (route->isAsync()) {
+            co_await route->callAsync(request, response);
+        } else {
+            ZoneScopedN("HandleRoute"); //NOLINT
+            route->call(request, response);
         }
-        clientQueueCond_.notify_one();
+    } catch (...) {
+        failed = true;
+    }
+
+    if (failed) {
+        ZoneScopedN("HandleError"); //NOLINT
+        response.reset();
+        response.status(500);
     }
 }
 
-void server::TcpServer::cleanupFinishedThreads()
+coro::Task<> server::Server::serveHttp2(const TcpServer& listener, const int clientFd, const std::string& clientIP,
+                                        const std::uint64_t connection, std::string received, const http::Request* upgrade)
 {
-    const std::lock_guard lock(threadMutex_);
-    erase_if(serverThreads_, [](const std::thread& t) {
-        return !t.joinable();
-    });
+    http2::Connection session(clientFd, *this, listener, clientIP);
+    if (capture_) {
+        session.onReceive([this, &listener, connection](const std::string_view bytes) {
+            capture_->received(connection, listener.port(), bytes);
+        });
+    }
+    co_await session.run(std::move(received), upgrade);
 }
 
 //* function to block to many requests. Prevents ddos attacks
-bool server::TcpServer::blockTooManyRequests(const std::string& ip)
+bool server::Server::blockTooManyRequests(const std::string& ip)
 {
     const std::lock_guard lock(ipMutex_);
     const auto now = std::chrono::steady_clock::now();
@@ -189,171 +357,195 @@ bool server::TcpServer::blockTooManyRequests(const std::string& ip)
     return false;
 }
 
-void server::TcpServer::workerLoop()
+coro::Task<> server::Server::handleClient(TcpServer& listener, int clientFd)
 {
-
-    tracy::SetThreadName("WorkerThread");
-    ZoneScoped; //NOLINT
-    const auto threadId = std::this_thread::get_id();
+    EventLoop& loop = EventLoop::current();
+    //* no per-connection log line here, a shared stdout lock on every accept serializes all the loops
+    std::string clientIP(INET_ADDRSTRLEN, '\0');
     {
-        const std::lock_guard lock(loggingMutex_);
-        std::cout << "[DISPATCH] Worker started: Thread ID = " << threadId << '\n';
+        ZoneScopedN("GetClientInfo"); //NOLINT
+        sockaddr_in clientAddr{};
+        socklen_t addrLen = sizeof(clientAddr);
+        //*getpeername -> return peer address of connected socket (https://pubs.opengroup.org/onlinepubs/007904875/functions/getpeername.html)
+        getpeername(clientFd, reinterpret_cast<sockaddr*>(&clientAddr), &addrLen);
+
+        // converting the ip address from binary to 'human' xd
+        inet_ntop(AF_INET, &clientAddr.sin_addr, clientIP.data(), INET_ADDRSTRLEN);
+        clientIP.resize(std::strlen(clientIP.c_str()));
     }
 
-    while (true) {
-        int clientFd = 0;
-        {
-            ZoneScopedN("WaitForClient"); //NOLINT
-            std::unique_lock lock(clientQueueMutex_);
-            clientQueueCond_.wait(lock, [this] {
-                return stop_ || !clientQueue_.empty();
-            });
-            if (stop_ && clientQueue_.empty())
-            {
-                return;
-            }
-            clientFd = clientQueue_.front();
-            clientQueue_.pop();
-        }
+    const std::uint64_t connection = nextConnection_.fetch_add(1, std::memory_order_relaxed);
+    if (capture_) {
+        capture_->opened(connection, listener.port());
+    }
 
-        {
-            const std::lock_guard lock(loggingMutex_);
-            std::cout << "[DISPATCH] Worker Thread " << threadId << " handling client fd = " << clientFd << '\n';
-        }
-        handleClient(clientFd);
+    try {
+        co_await serveConnection(listener, clientFd, clientIP, connection);
+    } catch (...) {
+        //* a detached task swallows its exception, the socket below still has to be closed
+    }
+
+    if (capture_) {
+        capture_->closed(connection, listener.port());
     }
+    loop.close(clientFd);
 }
 
-void server::TcpServer::handleClient(int clientFd)
+coro::Task<> server::Server::serveConnection(const TcpServer& listener, const int clientFd, const std::string& clientIP,
+                                             const std::uint64_t connection)
 {
-    ZoneScopedN("TcpServer::handleClient"); //NOLINT
+    bool limited = false;
     {
-        ZoneScopedN("GetClientInfo"); //NOLINT
-        const std::lock_guard lock(loggingMutex_);
-        std::cout << "[HANDLE] Thread" << std::this_thread::get_id() << " handling client fd = " << clientFd << '\n';
+        ZoneScopedN("RateLimit"); //NOLINT
+        limited = rateLimit_ && blockTooManyRequests(clientIP);
     }
-    // Atomic clock implementation
-    sockaddr_in clientAddr{};
-    socklen_t addrLen = sizeof(clientAddr);
-    //*getpeername -> return peer address of connected socket (https://pubs.opengroup.org/onlinepubs/007904875/functions/getpeername.html)
-    getpeername(clientFd, reinterpret_cast<sockaddr*>(&clientAddr), &addrLen);
-
-    // allocating buffer space to store Ipv4 address
-    std::string clientIP(INET_ADDRSTRLEN, '\0');
-    // converting the ip address from binary to 'human' xd
-    inet_ntop(AF_INET, &clientAddr.sin_addr, clientIP.data(), INET_ADDRSTRLEN);
-    clientIP.resize(std::strlen(clientIP.c_str()));
-
-    if (blockTooManyRequests(clientIP))
+    if (limited)
     {
-        ZoneScopedN("RateLimit"); //NOLINT
-        const std::string response = "HTTP/1.1 429 Too Many Requests\r\n\r\n";
-        send(clientFd, response.data(), response.size(), 0);
-        close(clientFd);
-        return;
+        //* look at what the client sent first, a prior knowledge HTTP/2 client can't read an HTTP/1 status line
+        std::array<char, http2::prefaceHead.size()> first{};
+        const ssize_t bytes = co_await coro::recvSome(clientFd, first, EventLoop::Clock::now() + requestTimeout);
+        if (capture_ && bytes > 0) {
+            capture_->received(connection, listener.port(), std::string_view(first.data(), static_cast<std::size_t>(bytes)));
+        }
+        if (listener.http2Enabled() && std::string_view(first.data(), static_cast<std::size_t>(std::max<ssize_t>(bytes, 0))) == http2::prefaceHead) {
+            co_await coro::sendAll(clientFd, http2::refuseConnection(http2::ErrorCode::EnhanceYourCalm));
+        } else if (bytes > 0) {
+            co_await coro::sendAll(clientFd, "HTTP/1.1 429 Too Many Requests\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+        }
+        co_return;
     }
 
-
+    //* bytes read from the socket but not consumed yet, pipelined requests stay here for the next round.
+    //* request, response and out live as long as the connection so their buffers get reused
+    std::string buffer;
+    std::string out;
+    http::Request request;
+    http::Response response;
     while (true) {
-        ZoneScopedN("ProcessRequest"); //NOLINT
-        const std::string request = utils::readRequest(clientFd);
+        const EventLoop::Clock::time_point deadline = EventLoop::Clock::now() + requestTimeout;
+        bool timedOut = false;
+        std::size_t headerEnd = std::string::npos;
+        bool connectionOpen = true;
+        //* only scan the bytes that arrived since the last try, a terminator may straddle the two reads
+        std::size_t scanFrom = 0;
+        while ((headerEnd = simd::findHeaderEnd(buffer, scanFrom)) == std::string::npos && buffer.size() < maxRequestSize) {
+            const std::size_t used = buffer.size();
+            scanFrom = used > 3 ? used - 3 : 0;
+            //* never read past the limit, the size checks below rely on the head fitting into maxRequestSize
+            buffer.resize(used + std::min(readChunk, maxRequestSize - used));
+            const ssize_t bytes = co_await coro::recvSome(clientFd, std::span(buffer).subspan(used), deadline);
+            timedOut = bytes < 0 && errno == ETIMEDOUT;
+            buffer.resize(used + static_cast<std::size_t>(std::max<ssize_t>(bytes, 0)));
+            if (capture_ && bytes > 0) {
+                capture_->received(connection, listener.port(), std::string_view(buffer).substr(used));
+            }
+            if (bytes <= 0) {
+                connectionOpen = false;
+                break;
+            }
+        }
+        if (!connectionOpen) {
+            //* an idle keep-alive connection is just closed, a half sent request gets told why
+            if (timedOut && !buffer.empty()) {
+                co_await coro::sendAll(clientFd, "HTTP/1.1 408 Request Timeout\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+            }
+            break;
+        }
+        if (headerEnd == std::string::npos || headerEnd + 4 > maxRequestSize) {
+            co_await coro::sendAll(clientFd, "HTTP/1.1 431 Request Header Fields Too Large\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+            break;
+        }
 
-        if (request.empty()) {
+        if (listener.http2Enabled() && buffer.starts_with(http2::prefaceHead)) {
+            co_await serveHttp2(listener, clientFd, clientIP, connection, std::move(buffer), nullptr);
             break;
         }
 
-        std::istringstream iss(request);
-        std::string method;
-        std::string path;
-        std::string version;
-        iss >> method >> path >> version;
-
-        std::unordered_map<std::string, std::string> headers;
-        std::string line;
-        std::getline(iss, line);
-
-        while (std::getline(iss, line) && line != "\r" && !line.empty()) {
-            if (const auto currentPos = line.find(':'); currentPos != std::string::npos) {
-                std::string key = utils::trim(line.substr(0, currentPos));
-                const std::string value = utils::trim(line.substr(currentPos + 1));
-                std::ranges::transform(key, key.begin(), [](const unsigned char c) { return std::tolower(c); });
-                headers[key] = value;
-            }
+        request.reset();
+        response.reset();
+        out.clear();
+        if (!request.parse(std::span(buffer).first(headerEnd + 2))) {
+            co_await coro::sendAll(clientFd, "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+            break;
         }
 
-        try {
-            ZoneScopedN("HandleRoute"); //NOLINT
-            const router::RequestType type = toRequestType(method);
-            const std::string body = extractBody(request);
-            const router::RouteHandler routeHandler = router_.getHandler(type, path);
-
-            std::string response;
-            if (routeHandler) {
-                const std::string content = routeHandler(path, body);
-                std::ostringstream oss;
-                oss << "HTTP/1.1 200 OK\r\n"
-                    << "Content-Type: text/plain\r\n"
-                    << "Content-Length: " << content.size() << "\r\n"
-                    << "Connection: " << (utils::shouldKeepAlive(version, headers) ? "keep-alive" : "close") << "\r\n\r\n"
-                    << content;
-
-                response = oss.str();
-                send(clientFd, response.c_str(), response.size(), 0);
-                std::cout << "Connection header: " << headers["connection"] << '\n';
-                std::cout << "Will keep alive: " << std::boolalpha << utils::shouldKeepAlive(version, headers) << '\n';
+        //* there is no chunked decoding. Guessing the body length differently than a proxy in front of us
+        //* is how requests get smuggled, so Transfer-Encoding and ambiguous lengths end the connection
+        if (!request.header(http::Header::TransferEncoding).empty()) {
+            if (request.header(http::Header::ContentLength).empty()) {
+                co_await coro::sendAll(clientFd, "HTTP/1.1 501 Not Implemented\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
             } else {
-                response = "HTTP/1.1 404 Not Found\r\n\r\nRoute not found";
-                send(clientFd, response.c_str(), response.size(), 0);
+                co_await coro::sendAll(clientFd, "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
             }
-        } catch (exceptions::HandlerException&) {
-            ZoneScopedN("HandleError"); //NOLINT
-            const std::string response500 = "HTTP/1.1 500 Internal Server Error\r\n\r\n";
-            send(clientFd, response500.c_str(), response500.size(), 0);
+            break;
+        }
+        if (conflictingContentLength(request)) {
+            co_await coro::sendAll(clientFd, "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+            break;
         }
-    }
-
-    if (clientFd < 0) {
-        std::cerr << "[ERROR] Invalid clientFd\n";
-        return;
-    }
 
-    close(clientFd);
-}
+        //* wait for the rest of the body, the handler only runs on a complete request
+        std::size_t contentLength = 0;
+        if (const std::string_view length = request.header(http::Header::ContentLength); !length.empty()) {
+            const auto [ptr, ec] = std::from_chars(length.data(), length.data() + length.size(), contentLength);
+            if (ec != std::errc{} || ptr != length.data() + length.size()) {
+                co_await coro::sendAll(clientFd, "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+                break;
+            }
+        }
+        const std::size_t bodyStart = headerEnd + 4;
+        //* written so it can't wrap, bodyStart + contentLength could for a length near 2^64
+        if (bodyStart > maxRequestSize || contentLength > maxRequestSize - bodyStart) {
+            co_await coro::sendAll(clientFd, "HTTP/1.1 413 Content Too Large\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+            break;
+        }
+        const std::size_t requestSize = bodyStart + contentLength;
+        if (buffer.capacity() < requestSize) {
+            //* growing the buffer moves it, the request views have to follow
+            const char* oldBase = buffer.data();
+            buffer.reserve(requestSize);
+            request.rebase(oldBase, buffer.data());
+        }
+        while (buffer.size() < requestSize && connectionOpen) {
+            const std::size_t used = buffer.size();
+            buffer.resize(requestSize);
+            const ssize_t bytes = co_await coro::recvSome(clientFd, std::span(buffer).subspan(used), deadline);
+            timedOut = bytes < 0 && errno == ETIMEDOUT;
+            buffer.resize(used + static_cast<std::size_t>(std::max<ssize_t>(bytes, 0)));
+            if (capture_ && bytes > 0) {
+                capture_->received(connection, listener.port(), std::string_view(buffer).substr(used));
+            }
+            connectionOpen = bytes > 0;
+        }
+        if (!connectionOpen) {
+            if (timedOut) {
+                co_await coro::sendAll(clientFd, "HTTP/1.1 408 Request Timeout\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+            }
+            break;
+        }
+        request.setBody(std::string_view(buffer).substr(bodyStart, contentLength));
+        request.setClientAddress(clientIP);
+        const bool keepAlive = utils::shouldKeepAlive(request.version(), request.header(http::Header::Connection));
 
-auto server::TcpServer::extractBody(const std::string &request) -> std::string
-{
-    auto pos = request.find("\r\n\r\n");
-    return pos==std::string::npos ? "" : request.substr(pos+4);
-}
+        if (listener.http2Enabled() && http2::wantsUpgrade(request)) {
+            //* the upgraded request is answered as stream 1, whatever was pipelined behind it is already HTTP/2
+            co_await serveHttp2(listener, clientFd, clientIP, connection, buffer.substr(requestSize), &request);
+            break;
+        }
 
-auto server::TcpServer::dispatchLoop() -> void
-{
-    tracy::SetThreadName("Dispatcher");
-    ZoneScoped; //NOLINT
-    while (true)
-    {
-        int clientFd = 0;
+        co_await route(listener, request, response);
         {
-            //* Pulling socket from the thread, then removing it from queue and handling
-            //* returning from wait
-            ZoneScopedN("TcpServer::dispatchLoop"); //NOLINT
-            std::unique_lock lock(clientQueueMutex_);
-            //* [this] capturing the current pointer to client
-            clientQueueCond_.wait(lock, [this] {
-                return !clientQueue_.empty();
-            });
-
-            clientFd = clientQueue_.front();
-            clientQueue_.pop();
+            ZoneScopedN("SerializeResponse"); //NOLINT
+            response.serializeHead(out, keepAlive);
+        }
+        const bool sent = co_await coro::sendAll(clientFd, out, response.bodyView());
+        buffer.erase(0, requestSize);
+        if (!sent || !keepAlive) {
+            break;
         }
-        cleanupFinishedThreads();
-        serverThreads_.emplace_back([this, clientFd] {
-            handleClient(clientFd);
-        });
     }
 }
 
-
 int main()
 {
     tracy::SetThreadName("MainThread");
@@ -361,45 +553,51 @@ int main()
     try {
         router::Router routerA;
         router::Router routerB;
-        routerA.addRoute(router::RequestType::GET, "/hello", [](const std::string&, const std::string&) {
+        routerA.addRoute(router::RequestType::GET, "/hello", [](const http::Request&, http::Response& response) {
             ZoneScoped; //NOLINT
-            return "Hello from portA !";
+            response.staticBody("Hello from portA !");
         });
 
+        //* old (path, body) handlers still work, they run on the worker pool
         routerA.addRoute(router::RequestType::PUT, "/goodbye", [](const std::string&, const std::string&) {
             ZoneScoped; //NOLINT
             return "Goodbye from Port A!";
         });
 
-        routerB.addRoute(router::RequestType::GET, "/hello", [](const std::string&, const std::string&) {
-            ZoneScoped; //NOLINT
-            return "Hello from portB !";
+        //* Slow handler that doesn't hold a thread while it waits
+        routerA.addRoute(router::RequestType::GET, "/slow", [](const http::Request&, http::Response& response) -> coro::Task<> {
+            co_await coro::sleepFor(std::chrono::milliseconds(200));
+            response.staticBody("Slow hello from portA !");
         });
-        server::TcpServer serverA(4222, routerA);
-        server::TcpServer serverB(4444, routerB);
-        std::cout << "Waiting for a client to connect...\n";
 
-        std::thread serverAThread([&serverA]() {
-            tracy::SetThreadName("TcpServer::serverAThread");
+        routerA.addRoute(router::RequestType::GET, "/whoami", [](const http::Request& request, http::Response& response) {
             ZoneScoped; //NOLINT
-            serverA.run();
+            std::string body = "You are ";
+            body.append(request.clientAddress()).append(" (").append(request.header(http::Header::UserAgent)).append(")");
+            if (const auto name = request.queryParam("name")) {
+                body.append(", hi ").append(*name);
+            }
+            response.header("Cache-Control", "no-store").body(std::move(body));
         });
 
-        std::thread serverBThread([&serverB]() {
-            tracy::SetThreadName("TcpServer::serverBThread");
+        routerB.addRoute(router::RequestType::GET, "/hello", [](const http::Request&, http::Response& response) {
             ZoneScoped; //NOLINT
-            serverB.run();
+            response.staticBody("Hello from portB !");
         });
-
-        if (serverAThread.joinable())
-        {
-            serverAThread.join();
+        //* Both ports (and the b.localhost virtual host) share the same loops and workers
+        server::Server runtime;
+        //* HTTP_SERVER_CAPTURE=traffic.cap records the incoming traffic for tests/replay.py
+        if (const char* capturePath = std::getenv("HTTP_SERVER_CAPTURE")) {
+            runtime.enableCapture(capturePath);
         }
-
-        if (serverBThread.joinable())
-        {
-            serverBThread.join();
+        //* HTTP_SERVER_NO_RATE_LIMIT=1 for benchmarks, e.g. tests/replay.py --speed max
+        if (const char* noLimit = std::getenv("HTTP_SERVER_NO_RATE_LIMIT"); noLimit != nullptr && std::string_view(noLimit) != "0") {
+            runtime.rateLimit(false);
         }
+        runtime.listen(4222, routerA).addVirtualHost("b.localhost", routerB);
+        runtime.listen(4444, routerB);
+        std::cout << "Waiting for a client to connect...\n";
+        runtime.run();
 
     } catch (const std::exception& ex) {
         std::cerr << ex.what() << '\n';
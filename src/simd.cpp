@@ -0,0 +1,625 @@
+#include "server/simd.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HTTP_SIMD_X86 1
+#include <immintrin.h>
+#define HTTP_TARGET(isa) __attribute__((target(isa)))
+#else
+#define HTTP_SIMD_X86 0
+#endif
+
+namespace
+{
+constexpr std::size_t npos = std::string_view::npos;
+
+//* tchar from RFC 9110 section 5.6.2
+constexpr std::array<bool, 256> tokenTable = [] {
+    std::array<bool, 256> table{};
+    for (unsigned char c = '0'; c <= '9'; ++c)
+    {
+        table[c] = true;
+    }
+    for (unsigned char c = 'a'; c <= 'z'; ++c)
+    {
+        table[c] = true;
+        table[c - 'a' + 'A'] = true;
+    }
+    for (const char c : std::string_view("!#$%&'*+-.^_`|~"))
+    {
+        table[static_cast<unsigned char>(c)] = true;
+    }
+    return table;
+}();
+
+//* Same table split by nibbles for pshufb: bit (byte >> 4) of entry (byte & 0xF) is set for every token byte.
+//* Bytes >= 0x80 have a high nibble without a bit and come out invalid.
+constexpr std::array<std::uint8_t, 16> tokenLowNibble = [] {
+    std::array<std::uint8_t, 16> lut{};
+    for (unsigned b = 0; b < 128; ++b)
+    {
+        if (tokenTable[b])
+        {
+            lut[b & 0xFU] = static_cast<std::uint8_t>(lut[b & 0xFU] | (1U << (b >> 4U)));
+        }
+    }
+    return lut;
+}();
+
+constexpr char toLowerAscii(const char c) noexcept
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+#if HTTP_SIMD_X86
+//* The loops stop at the last whole block. Instead of finishing byte by byte, the tail is one more
+//* block loaded so that it ends exactly at the end of the data, with the bits we already checked masked off.
+constexpr unsigned freshBits(const std::size_t next, const std::size_t last) noexcept
+{
+    return static_cast<unsigned>(~std::uint64_t{0} << (next - last));
+}
+
+//* ------------------------------------------------------------------ SSE4.2
+HTTP_TARGET("sse4.2") __m128i lowerSse(const __m128i v)
+{
+    const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return _mm_add_epi8(v, _mm_and_si128(upper, _mm_set1_epi8('a' - 'A')));
+}
+
+HTTP_TARGET("sse4.2") __m128i loadSse(const char* p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+HTTP_TARGET("sse4.2") unsigned maskSse(const __m128i v, const char byte)
+{
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(byte))));
+}
+
+HTTP_TARGET("sse4.2") std::size_t findHeaderEndSse(const std::string_view data, std::size_t from) noexcept
+{
+    const char* p = data.data();
+    std::size_t i = from;
+    for (; i + 16 + 3 <= data.size(); i += 16)
+    {
+        const unsigned mask = maskSse(loadSse(p + i), '\r') & maskSse(loadSse(p + i + 1), '\n')
+                              & maskSse(loadSse(p + i + 2), '\r') & maskSse(loadSse(p + i + 3), '\n');
+        if (mask != 0U)
+        {
+            return i + static_cast<std::size_t>(__builtin_ctz(mask));
+        }
+    }
+    if (i >= data.size() || data.size() < i + 3)
+    {
+        return npos;
+    }
+    if (data.size() < from + 16 + 3)
+    {
+        return simd::scalar::findHeaderEnd(data, i);
+    }
+    const std::size_t last = data.size() - 16 - 3;
+    const unsigned mask = maskSse(loadSse(p + last), '\r') & maskSse(loadSse(p + last + 1), '\n')
+                          & maskSse(loadSse(p + last + 2), '\r') & maskSse(loadSse(p + last + 3), '\n')
+                          & freshBits(i, last);
+    return mask != 0U ? last + static_cast<std::size_t>(__builtin_ctz(mask)) : npos;
+}
+
+HTTP_TARGET("sse4.2") std::size_t findCrlfSse(const std::string_view data) noexcept
+{
+    const char* p = data.data();
+    std::size_t i = 0;
+    for (; i + 16 + 1 <= data.size(); i += 16)
+    {
+        if (const unsigned mask = maskSse(loadSse(p + i), '\r') & maskSse(loadSse(p + i + 1), '\n'); mask != 0U)
+        {
+            return i + static_cast<std::size_t>(__builtin_ctz(mask));
+        }
+    }
+    if (data.size() < 16 + 1)
+    {
+        return simd::scalar::findCrlf(data);
+    }
+    const std::size_t last = data.size() - 16 - 1;
+    const unsigned mask = maskSse(loadSse(p + last), '\r') & maskSse(loadSse(p + last + 1), '\n') & freshBits(i, last);
+    return mask != 0U ? last + static_cast<std::size_t>(__builtin_ctz(mask)) : npos;
+}
+
+HTTP_TARGET("sse4.2") std::size_t findByteSse(const std::string_view data, const char byte) noexcept
+{
+    const char* p = data.data();
+    std::size_t i = 0;
+    for (; i + 16 <= data.size(); i += 16)
+    {
+        if (const unsigned mask = maskSse(loadSse(p + i), byte); mask != 0U)
+        {
+            return i + static_cast<std::size_t>(__builtin_ctz(mask));
+        }
+    }
+    if (data.size() < 16)
+    {
+        return simd::scalar::findByte(data, byte);
+    }
+    const std::size_t last = data.size() - 16;
+    const unsigned mask = maskSse(loadSse(p + last), byte) & freshBits(i, last);
+    return mask != 0U ? last + static_cast<std::size_t>(__builtin_ctz(mask)) : npos;
+}
+
+//* Turns a bitmask of CRLF starts into offsets, shared by the vector kernels
+std::size_t emitPositions(unsigned mask, const std::size_t base, const std::span<std::uint32_t> out, std::size_t count) noexcept
+{
+    while (mask != 0U && count < out.size())
+    {
+        out[count++] = static_cast<std::uint32_t>(base + static_cast<std::size_t>(__builtin_ctz(mask)));
+        mask &= mask - 1;
+    }
+    return count;
+}
+
+HTTP_TARGET("sse4.2") std::size_t lineEndsSse(const std::string_view data, const std::span<std::uint32_t> out) noexcept
+{
+    const char* p = data.data();
+    std::size_t i = 0;
+    std::size_t count = 0;
+    for (; i + 16 + 1 <= data.size() && count < out.size(); i += 16)
+    {
+        count = emitPositions(maskSse(loadSse(p + i), '\r') & maskSse(loadSse(p + i + 1), '\n'), i, out, count);
+    }
+    if (count == out.size() || i >= data.size())
+    {
+        return count;
+    }
+    if (data.size() < 16 + 1)
+    {
+        return simd::scalar::lineEnds(data, out);
+    }
+    const std::size_t last = data.size() - 16 - 1;
+    return emitPositions(maskSse(loadSse(p + last), '\r') & maskSse(loadSse(p + last + 1), '\n') & freshBits(i, last),
+                         last,
+                         out,
+                         count);
+}
+
+HTTP_TARGET("sse4.2") bool isTokenSse(const std::string_view data) noexcept
+{
+    if (data.empty())
+    {
+        return false;
+    }
+    const __m128i lowLut = loadSse(reinterpret_cast<const char*>(tokenLowNibble.data()));
+    const __m128i highLut = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+
+    if (data.size() < 16)
+    {
+        return simd::scalar::isToken(data);
+    }
+    const char* p = data.data();
+    //* the last block overlaps the previous one, checking a byte twice doesn't change the answer
+    for (std::size_t i = 0; i < data.size(); i += 16)
+    {
+        const __m128i v = loadSse(p + std::min(i, data.size() - 16));
+        const __m128i low = _mm_shuffle_epi8(lowLut, _mm_and_si128(v, nibble));
+        const __m128i high = _mm_shuffle_epi8(highLut, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+        const __m128i invalid = _mm_cmpeq_epi8(_mm_and_si128(low, high), _mm_setzero_si128());
+        if (_mm_movemask_epi8(invalid) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+HTTP_TARGET("sse4.2") bool equalsIgnoreCaseSse(const std::string_view data, const std::string_view lower) noexcept
+{
+    if (data.size() != lower.size())
+    {
+        return false;
+    }
+    if (data.size() < 16)
+    {
+        return simd::scalar::equalsIgnoreCase(data, lower);
+    }
+    for (std::size_t i = 0; i < data.size(); i += 16)
+    {
+        const std::size_t at = std::min(i, data.size() - 16);
+        const __m128i eq = _mm_cmpeq_epi8(lowerSse(loadSse(data.data() + at)), loadSse(lower.data() + at));
+        if (_mm_movemask_epi8(eq) != 0xFFFF)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+HTTP_TARGET("sse4.2") void toLowerSse(const std::span<char> data) noexcept
+{
+    if (data.size() < 16)
+    {
+        simd::scalar::toLower(data);
+        return;
+    }
+    //* lowering a byte twice is harmless, so the tail block can overlap
+    for (std::size_t i = 0; i < data.size(); i += 16)
+    {
+        char* at = data.data() + std::min(i, data.size() - 16);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(at), lowerSse(loadSse(at)));
+    }
+}
+
+//* ------------------------------------------------------------------ AVX2
+HTTP_TARGET("avx2") __m256i lowerAvx2(const __m256i v)
+{
+    const __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+                                           _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+    return _mm256_add_epi8(v, _mm256_and_si256(upper, _mm256_set1_epi8('a' - 'A')));
+}
+
+HTTP_TARGET("avx2") __m256i loadAvx2(const char* p)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+HTTP_TARGET("avx2") unsigned maskAvx2(const __m256i v, const char byte)
+{
+    return static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(byte))));
+}
+
+HTTP_TARGET("avx2") std::size_t findHeaderEndAvx2(const std::string_view data, std::size_t from) noexcept
+{
+    const char* p = data.data();
+    std::size_t i = from;
+    for (; i + 32 + 3 <= data.size(); i += 32)
+    {
+        const unsigned mask = maskAvx2(loadAvx2(p + i), '\r') & maskAvx2(loadAvx2(p + i + 1), '\n')
+                              & maskAvx2(loadAvx2(p + i + 2), '\r') & maskAvx2(loadAvx2(p + i + 3), '\n');
+        if (mask != 0U)
+        {
+            return i + static_cast<std::size_t>(__builtin_ctz(mask));
+        }
+    }
+    if (i >= data.size() || data.size() < i + 3)
+    {
+        return npos;
+    }
+    if (data.size() < from + 32 + 3)
+    {
+        return findHeaderEndSse(data, i);
+    }
+    const std::size_t last = data.size() - 32 - 3;
+    const unsigned mask = maskAvx2(loadAvx2(p + last), '\r') & maskAvx2(loadAvx2(p + last + 1), '\n')
+                          & maskAvx2(loadAvx2(p + last + 2), '\r') & maskAvx2(loadAvx2(p + last + 3), '\n')
+                          & freshBits(i, last);
+    return mask != 0U ? last + static_cast<std::size_t>(__builtin_ctz(mask)) : npos;
+}
+
+HTTP_TARGET("avx2") std::size_t findCrlfAvx2(const std::string_view data) noexcept
+{
+    const char* p = data.data();
+    std::size_t i = 0;
+    for (; i + 32 + 1 <= data.size(); i += 32)
+    {
+        if (const unsigned mask = maskAvx2(loadAvx2(p + i), '\r') & maskAvx2(loadAvx2(p + i + 1), '\n'); mask != 0U)
+        {
+            return i + static_cast<std::size_t>(__builtin_ctz(mask));
+        }
+    }
+    if (data.size() < 32 + 1)
+    {
+        return findCrlfSse(data);
+    }
+    const std::size_t last = data.size() - 32 - 1;
+    const unsigned mask = maskAvx2(loadAvx2(p + last), '\r') & maskAvx2(loadAvx2(p + last + 1), '\n') & freshBits(i, last);
+    return mask != 0U ? last + static_cast<std::size_t>(__builtin_ctz(mask)) : npos;
+}
+
+HTTP_TARGET("avx2") std::size_t findByteAvx2(const std::string_view data, const char byte) noexcept
+{
+    const char* p = data.data();
+    std::size_t i = 0;
+    for (; i + 32 <= data.size(); i += 32)
+    {
+        if (const unsigned mask = maskAvx2(loadAvx2(p + i), byte); mask != 0U)
+        {
+            return i + static_cast<std::size_t>(__builtin_ctz(mask));
+        }
+    }
+    if (data.size() < 32)
+    {
+        return findByteSse(data, byte);
+    }
+    const std::size_t last = data.size() - 32;
+    const unsigned mask = maskAvx2(loadAvx2(p + last), byte) & freshBits(i, last);
+    return mask != 0U ? last + static_cast<std::size_t>(__builtin_ctz(mask)) : npos;
+}
+
+HTTP_TARGET("avx2") std::size_t lineEndsAvx2(const std::string_view data, const std::span<std::uint32_t> out) noexcept
+{
+    const char* p = data.data();
+    std::size_t i = 0;
+    std::size_t count = 0;
+    for (; i + 32 + 1 <= data.size() && count < out.size(); i += 32)
+    {
+        count = emitPositions(maskAvx2(loadAvx2(p + i), '\r') & maskAvx2(loadAvx2(p + i + 1), '\n'), i, out, count);
+    }
+    if (count == out.size() || i >= data.size())
+    {
+        return count;
+    }
+    if (data.size() < 32 + 1)
+    {
+        return lineEndsSse(data, out);
+    }
+    const std::size_t last = data.size() - 32 - 1;
+    return emitPositions(maskAvx2(loadAvx2(p + last), '\r') & maskAvx2(loadAvx2(p + last + 1), '\n') & freshBits(i, last),
+                         last,
+                         out,
+                         count);
+}
+
+HTTP_TARGET("avx2") bool isTokenAvx2(const std::string_view data) noexcept
+{
+    if (data.empty())
+    {
+        return false;
+    }
+    //* pshufb works per 128 bit lane, so both lanes get the same tables
+    const __m256i lowLut = _mm256_broadcastsi128_si256(loadSse(reinterpret_cast<const char*>(tokenLowNibble.data())));
+    const __m256i highLut = _mm256_broadcastsi128_si256(_mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0));
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+    if (data.size() < 32)
+    {
+        return isTokenSse(data);
+    }
+    const char* p = data.data();
+    for (std::size_t i = 0; i < data.size(); i += 32)
+    {
+        const __m256i v = loadAvx2(p + std::min(i, data.size() - 32));
+        const __m256i low = _mm256_shuffle_epi8(lowLut, _mm256_and_si256(v, nibble));
+        const __m256i high = _mm256_shuffle_epi8(highLut, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        const __m256i invalid = _mm256_cmpeq_epi8(_mm256_and_si256(low, high), _mm256_setzero_si256());
+        if (_mm256_movemask_epi8(invalid) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+HTTP_TARGET("avx2") bool equalsIgnoreCaseAvx2(const std::string_view data, const std::string_view lower) noexcept
+{
+    if (data.size() != lower.size())
+    {
+        return false;
+    }
+    if (data.size() < 32)
+    {
+        return equalsIgnoreCaseSse(data, lower);
+    }
+    for (std::size_t i = 0; i < data.size(); i += 32)
+    {
+        const std::size_t at = std::min(i, data.size() - 32);
+        const __m256i eq = _mm256_cmpeq_epi8(lowerAvx2(loadAvx2(data.data() + at)), loadAvx2(lower.data() + at));
+        if (static_cast<unsigned>(_mm256_movemask_epi8(eq)) != 0xFFFFFFFFU)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+HTTP_TARGET("avx2") void toLowerAvx2(const std::span<char> data) noexcept
+{
+    if (data.size() < 32)
+    {
+        toLowerSse(data);
+        return;
+    }
+    for (std::size_t i = 0; i < data.size(); i += 32)
+    {
+        char* at = data.data() + std::min(i, data.size() - 32);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(at), lowerAvx2(loadAvx2(at)));
+    }
+}
+#endif
+
+struct Kernels
+{
+    std::size_t (*findHeaderEnd)(std::string_view, std::size_t) noexcept;
+    std::size_t (*findCrlf)(std::string_view) noexcept;
+    std::size_t (*findByte)(std::string_view, char) noexcept;
+    std::size_t (*lineEnds)(std::string_view, std::span<std::uint32_t>) noexcept;
+    bool (*isToken)(std::string_view) noexcept;
+    bool (*equalsIgnoreCase)(std::string_view, std::string_view) noexcept;
+    void (*toLower)(std::span<char>) noexcept;
+    simd::Level level;
+};
+
+constexpr Kernels scalarKernels{
+        simd::scalar::findHeaderEnd,
+        simd::scalar::findCrlf,
+        simd::scalar::findByte,
+        simd::scalar::lineEnds,
+        simd::scalar::isToken,
+        simd::scalar::equalsIgnoreCase,
+        simd::scalar::toLower,
+        simd::Level::Scalar,
+};
+
+#if HTTP_SIMD_X86
+constexpr Kernels sse42Kernels{
+        findHeaderEndSse,
+        findCrlfSse,
+        findByteSse,
+        lineEndsSse,
+        isTokenSse,
+        equalsIgnoreCaseSse,
+        toLowerSse,
+        simd::Level::SSE42,
+};
+
+constexpr Kernels avx2Kernels{
+        findHeaderEndAvx2,
+        findCrlfAvx2,
+        findByteAvx2,
+        lineEndsAvx2,
+        isTokenAvx2,
+        equalsIgnoreCaseAvx2,
+        toLowerAvx2,
+        simd::Level::AVX2,
+};
+#endif
+
+simd::Level detectLevel() noexcept
+{
+#if HTTP_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return simd::Level::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        return simd::Level::SSE42;
+    }
+#endif
+    return simd::Level::Scalar;
+}
+
+const Kernels* kernelsFor(const simd::Level level) noexcept
+{
+    switch (level)
+    {
+#if HTTP_SIMD_X86
+        case simd::Level::AVX2:
+            return &avx2Kernels;
+        case simd::Level::SSE42:
+            return &sse42Kernels;
+#endif
+        default:
+            return &scalarKernels;
+    }
+}
+
+const simd::Level supportedLevel = detectLevel();                           // NOLINT
+std::atomic<const Kernels*> activeKernels{kernelsFor(supportedLevel)};  // NOLINT
+
+const Kernels& kernels() noexcept
+{
+    return *activeKernels.load(std::memory_order_relaxed);
+}
+}  // namespace
+
+simd::Level simd::activeLevel() noexcept
+{
+    return kernels().level;
+}
+
+void simd::forceLevel(const Level level) noexcept
+{
+    activeKernels.store(kernelsFor(level <= supportedLevel ? level : supportedLevel), std::memory_order_relaxed);
+}
+
+std::size_t simd::findHeaderEnd(const std::string_view data, const std::size_t from) noexcept
+{
+    return kernels().findHeaderEnd(data, from);
+}
+
+std::size_t simd::findCrlf(const std::string_view data) noexcept
+{
+    return kernels().findCrlf(data);
+}
+
+std::size_t simd::findByte(const std::string_view data, const char byte) noexcept
+{
+    return kernels().findByte(data, byte);
+}
+
+std::size_t simd::lineEnds(const std::string_view data, const std::span<std::uint32_t> out) noexcept
+{
+    return kernels().lineEnds(data, out);
+}
+
+bool simd::isToken(const std::string_view data) noexcept
+{
+    return kernels().isToken(data);
+}
+
+bool simd::equalsIgnoreCase(const std::string_view data, const std::string_view lower) noexcept
+{
+    return kernels().equalsIgnoreCase(data, lower);
+}
+
+void simd::toLower(const std::span<char> data) noexcept
+{
+    kernels().toLower(data);
+}
+
+std::size_t simd::scalar::findHeaderEnd(const std::string_view data, const std::size_t from) noexcept
+{
+    return data.find("\r\n\r\n", from);
+}
+
+std::size_t simd::scalar::findCrlf(const std::string_view data) noexcept
+{
+    return data.find("\r\n");
+}
+
+std::size_t simd::scalar::findByte(const std::string_view data, const char byte) noexcept
+{
+    return data.find(byte);
+}
+
+std::size_t simd::scalar::lineEnds(const std::string_view data, const std::span<std::uint32_t> out) noexcept
+{
+    std::size_t count = 0;
+    for (std::size_t pos = data.find("\r\n"); pos != npos && count < out.size(); pos = data.find("\r\n", pos + 1))
+    {
+        out[count++] = static_cast<std::uint32_t>(pos);
+    }
+    return count;
+}
+
+bool simd::scalar::isToken(const std::string_view data) noexcept
+{
+    if (data.empty())
+    {
+        return false;
+    }
+    for (const char c : data)
+    {
+        if (!tokenTable[static_cast<unsigned char>(c)])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool simd::scalar::equalsIgnoreCase(const std::string_view data, const std::string_view lower) noexcept
+{
+    if (data.size() != lower.size())
+    {
+        return false;
+    }
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+        if (toLowerAscii(data[i]) != lower[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void simd::scalar::toLower(const std::span<char> data) noexcept
+{
+    for (char& c : data)
+    {
+        c = toLowerAscii(c);
+    }
+}
@@ -0,0 +1,63 @@
+#include "server/task.hpp"
+
+#include <new>
+
+coro::FramePool::Cache::~Cache()
+{
+    for (FreeNode* head : heads)
+    {
+        while (head != nullptr)
+        {
+            FreeNode* next = head->next;
+            ::operator delete(head);
+            head = next;
+        }
+    }
+}
+
+coro::FramePool::Cache& coro::FramePool::cache() noexcept
+{
+    thread_local Cache cache;
+    return cache;
+}
+
+void* coro::FramePool::allocate(const std::size_t size)
+{
+    const std::size_t cls = sizeClass(size);
+    if (cls >= kClasses)
+    {
+        return ::operator new(size);
+    }
+
+    Cache& c = cache();
+    if (FreeNode* node = c.heads[cls]; node != nullptr)
+    {
+        c.heads[cls] = node->next;
+        --c.counts[cls];
+        return node;
+    }
+    //* always allocate the whole class so a frame can be reused by any size that maps here
+    return ::operator new((cls + 1) * kGranularity);
+}
+
+void coro::FramePool::deallocate(void* ptr, const std::size_t size) noexcept
+{
+    const std::size_t cls = sizeClass(size);
+    if (cls >= kClasses)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+
+    //* a frame finishing on another thread just lands in that thread's cache
+    Cache& c = cache();
+    if (c.counts[cls] >= kMaxCachedPerClass)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+    auto* node = static_cast<FreeNode*>(ptr);
+    node->next = c.heads[cls];
+    c.heads[cls] = node;
+    ++c.counts[cls];
+}
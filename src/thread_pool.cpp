@@ -0,0 +1,59 @@
+#include "server/thread_pool.hpp"
+
+#include "tracy/Tracy.hpp"
+
+server::ThreadPool::ThreadPool(const std::size_t threads, const char* name)
+{
+    threads_.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i)
+    {
+        threads_.emplace_back([this, name] { workerLoop(name); });
+    }
+}
+
+server::ThreadPool::~ThreadPool()
+{
+    {
+        const std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    for (std::thread& t : threads_)
+    {
+        if (t.joinable())
+        {
+            t.join();
+        }
+    }
+}
+
+void server::ThreadPool::submit(std::move_only_function<void()> job)
+{
+    {
+        const std::lock_guard lock(mutex_);
+        jobs_.push(std::move(job));
+    }
+    cond_.notify_one();
+}
+
+void server::ThreadPool::workerLoop(const char* name)
+{
+    tracy::SetThreadName(name);
+    while (true)
+    {
+        std::move_only_function<void()> job;
+        {
+            ZoneScopedN("ThreadPool::WaitForJob");  // NOLINT
+            std::unique_lock lock(mutex_);
+            cond_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+            if (stop_ && jobs_.empty())
+            {
+                return;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop();
+        }
+        ZoneScopedN("ThreadPool::RunJob");  // NOLINT
+        job();
+    }
+}
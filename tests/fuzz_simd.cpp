@@ -0,0 +1,196 @@
+//* Differential fuzzer for the SIMD kernels: every level the CPU supports has to return exactly what
+//* simd::scalar returns, on random input and for every split point. Prints a small benchmark at the end.
+//*
+//*     cmake -S . -B build -DHTTP_SERVER_BUILD_FUZZ=ON && cmake --build build --target fuzz_simd
+//*     ./build/fuzz_simd [iterations per level] [seed]
+
+#include "server/simd.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <string_view>
+
+namespace
+{
+constexpr std::array levels{simd::Level::Scalar, simd::Level::SSE42, simd::Level::AVX2};
+
+const char* levelName(const simd::Level level)
+{
+    switch (level)
+    {
+        case simd::Level::Scalar: return "scalar";
+        case simd::Level::SSE42: return "sse4.2";
+        case simd::Level::AVX2: return "avx2";
+    }
+    return "?";
+}
+
+//* HTTP-ish bytes hit the interesting branches (CR/LF runs, separators, case) far more often than uniform noise
+std::string randomInput(std::mt19937_64& rng, const std::size_t size)
+{
+    static constexpr std::string_view alphabet{"\r\n:aZ- \t!\x80\xff,zA0~"};
+    std::string data(size, '\0');
+    switch (rng() % 3)
+    {
+        case 0:
+            std::ranges::generate(data, [&] { return alphabet[rng() % alphabet.size()]; });
+            break;
+        case 1:
+            std::ranges::generate(data, [&] { return static_cast<char>(rng()); });
+            break;
+        default:
+            std::ranges::generate(data, [&] { return "ab\r\n"[rng() % 4]; });
+            break;
+    }
+    return data;
+}
+
+std::string randomToken(std::mt19937_64& rng, const std::size_t size)
+{
+    static constexpr std::string_view tokenChars{"abcXYZ09!#~|^_`-."};
+    std::string token(size, '\0');
+    std::ranges::generate(token, [&] { return tokenChars[rng() % tokenChars.size()]; });
+    if (size > 0 && rng() % 2 == 0)
+    {
+        token[rng() % size] = static_cast<char>(rng());
+    }
+    return token;
+}
+
+//* Returns the name of the first kernel that disagrees with the scalar one, nullptr when all agree
+const char* check(std::mt19937_64& rng, const std::string& data)
+{
+    const std::size_t size = data.size();
+
+    const std::size_t from = rng() % (size + 2);
+    if (simd::findHeaderEnd(data, from) != simd::scalar::findHeaderEnd(data, from))
+    {
+        return "findHeaderEnd";
+    }
+    if (simd::findCrlf(data) != simd::scalar::findCrlf(data))
+    {
+        return "findCrlf";
+    }
+
+    const char byte = static_cast<char>(rng());
+    if (simd::findByte(data, byte) != simd::scalar::findByte(data, byte) || simd::findByte(data, '\n') != simd::scalar::findByte(data, '\n'))
+    {
+        return "findByte";
+    }
+
+    std::array<std::uint32_t, 64> ends{};
+    std::array<std::uint32_t, 64> expectedEnds{};
+    const std::size_t capacity = 1 + rng() % ends.size();
+    const std::size_t found = simd::lineEnds(data, std::span(ends).first(capacity));
+    if (found != simd::scalar::lineEnds(data, std::span(expectedEnds).first(capacity))
+        || !std::equal(ends.begin(), ends.begin() + found, expectedEnds.begin()))
+    {
+        return "lineEnds";
+    }
+
+    const std::string token = randomToken(rng, size);
+    if (simd::isToken(token) != simd::scalar::isToken(token) || simd::isToken(data) != simd::scalar::isToken(data))
+    {
+        return "isToken";
+    }
+
+    std::string lower = data;
+    simd::scalar::toLower(lower);
+    std::string lowered = data;
+    simd::toLower(lowered);
+    if (lowered != lower)
+    {
+        return "toLower";
+    }
+
+    std::string mixed = lower;
+    if (size > 0 && rng() % 2 == 0)
+    {
+        mixed[rng() % size] ^= 0x20;
+    }
+    if (simd::equalsIgnoreCase(mixed, lower) != simd::scalar::equalsIgnoreCase(mixed, lower)
+        || simd::equalsIgnoreCase(data, lower) != simd::scalar::equalsIgnoreCase(data, lower))
+    {
+        return "equalsIgnoreCase";
+    }
+    return nullptr;
+}
+
+//* What the parser does per request: find the head, split it into lines, check and match the names
+double benchmark()
+{
+    constexpr std::string_view request =
+            "GET /api/v1/users/12345?include=profile,settings HTTP/1.1\r\n"
+            "Host: api.example.com\r\n"
+            "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+            "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+            "Accept-Language: en-US,en;q=0.9,pl;q=0.8\r\n"
+            "Accept-Encoding: gzip, deflate, br\r\n"
+            "Cookie: session=abcdef0123456789abcdef0123456789; theme=dark; _ga=GA1.2.1234567890.1234567890\r\n"
+            "X-Request-Id: 4f1c2d3e-5a6b-7c8d-9e0f-112233445566\r\n"
+            "Connection: keep-alive\r\n"
+            "\r\n";
+    constexpr int iterations = 500000;
+
+    std::size_t sink = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        const std::string_view head = request.substr(0, simd::findHeaderEnd(request) + 2);
+        std::array<std::uint32_t, 32> ends{};
+        const std::size_t lines = simd::lineEnds(head, ends);
+        for (std::size_t line = 1; line < lines; ++line)
+        {
+            const std::string_view field = head.substr(ends[line - 1] + 2, ends[line] - ends[line - 1] - 2);
+            const std::string_view name = field.substr(0, simd::findByte(field, ':'));
+            sink += static_cast<std::size_t>(simd::isToken(name)) + static_cast<std::size_t>(simd::equalsIgnoreCase(name, "connection"));
+        }
+    }
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    if (sink == 0)
+    {
+        std::puts("benchmark did no work");
+    }
+    return elapsed.count() / iterations;
+}
+}  // namespace
+
+int main(const int argc, char** argv)
+{
+    const long iterations = argc > 1 ? std::strtol(argv[1], nullptr, 10) : 200000;
+    const std::uint64_t seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : std::random_device{}();
+    std::printf("seed %llu, %ld iterations per level\n", static_cast<unsigned long long>(seed), iterations);
+
+    const simd::Level supported = simd::activeLevel();
+    for (const simd::Level level : levels)
+    {
+        simd::forceLevel(level);
+        if (simd::activeLevel() != level)
+        {
+            std::printf("%-7s not supported by this CPU, skipped\n", levelName(level));
+            continue;
+        }
+
+        std::mt19937_64 rng(seed);
+        for (long i = 0; i < iterations; ++i)
+        {
+            //* long enough to cover several full vectors plus every possible tail length
+            const std::string data = randomInput(rng, rng() % 160);
+            if (const char* kernel = check(rng, data))
+            {
+                std::printf("%-7s %s differs from scalar after %ld inputs (seed %llu)\n", levelName(level), kernel, i,
+                            static_cast<unsigned long long>(seed));
+                return EXIT_FAILURE;
+            }
+        }
+        std::printf("%-7s ok, %.1f ns per request head\n", levelName(level), benchmark());
+    }
+    simd::forceLevel(supported);
+    return EXIT_SUCCESS;
+}
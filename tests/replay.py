@@ -0,0 +1,279 @@
+"""Replays a traffic capture (HTTP_SERVER_CAPTURE=file ./server) against a running server.
+
+Every captured connection gets its own socket and its chunks are sent exactly as recv() saw them,
+so keep-alive and pipelined requests reach the server in the same shape as the original traffic.
+
+    python3 tests/replay.py traffic.cap                    # original timing
+    python3 tests/replay.py traffic.cap --speed 4          # 4x faster
+    python3 tests/replay.py traffic.cap --speed max        # no delays at all
+    python3 tests/replay.py traffic.cap --dump             # print the capture and exit
+
+The server allows one connection per millisecond from each address and every replayed connection comes
+from the same one, so faster replays mostly measure 429s. Start the server with the limiter off:
+
+    HTTP_SERVER_NO_RATE_LIMIT=1 ./server
+
+Connections the server marked as truncated (its capture writer fell behind and lost some of their bytes)
+are not replayed, the report says how many were skipped.
+"""
+
+import argparse
+import asyncio
+import json
+import socket
+import struct
+import sys
+import time
+from collections import Counter
+from dataclasses import dataclass, field
+
+MAGIC = b"HTCAP01\n"
+H2_PREFACE = b"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+RECORD = struct.Struct("<BQQHI")
+OPEN, DATA, CLOSE, TRUNCATED = 0, 1, 2, 3
+
+
+@dataclass
+class Connection:
+    id: int
+    port: int
+    opened: float = 0.0
+    closed: float | None = None
+    truncated: bool = False
+    chunks: list = field(default_factory=list)  # (seconds since capture start, bytes)
+
+
+def load_capture(path):
+    with open(path, "rb") as f:
+        raw = f.read()
+    if not raw.startswith(MAGIC):
+        sys.exit(f"{path} is not a traffic capture")
+    connections = {}
+    pos = len(MAGIC)
+    while pos + RECORD.size <= len(raw):
+        kind, ns, conn, port, length = RECORD.unpack_from(raw, pos)
+        pos += RECORD.size
+        payload = raw[pos:pos + length]
+        pos += length
+        if len(payload) < length:
+            break  # the server was killed mid write, drop the torn record
+        seconds = ns / 1e9
+        c = connections.setdefault(conn, Connection(conn, port, seconds))
+        if kind == OPEN:
+            c.opened = seconds
+        elif kind == DATA:
+            c.chunks.append((seconds, payload))
+        elif kind == CLOSE:
+            c.closed = seconds
+        elif kind == TRUNCATED:
+            c.truncated = True
+    return sorted(connections.values(), key=lambda c: c.opened)
+
+
+def request_ends(stream):
+    """Offsets in the client byte stream where each complete request ends.
+    HTTP/2 bytes are replayed as they are but not measured, counting stops at the preface."""
+    ends = []
+    pos = 0
+    while not stream.startswith(H2_PREFACE, pos):
+        head_end = stream.find(b"\r\n\r\n", pos)
+        if head_end < 0:
+            return ends
+        length = 0
+        for line in stream[pos:head_end].split(b"\r\n")[1:]:
+            name, _, value = line.partition(b":")
+            if name.strip().lower() == b"content-length":
+                try:
+                    length = int(value.strip())
+                except ValueError:
+                    return ends
+        end = head_end + 4 + length
+        if end > len(stream):
+            return ends
+        ends.append(end)
+        pos = end
+    return ends
+
+
+class ResponseReader:
+    """Splits the server's byte stream into responses, every response carries a Content-Length."""
+
+    def __init__(self):
+        self.buffer = b""
+
+    def feed(self, data):
+        self.buffer += data
+        statuses = []
+        while True:
+            head_end = self.buffer.find(b"\r\n\r\n")
+            if head_end < 0:
+                return statuses
+            lines = self.buffer[:head_end].split(b"\r\n")
+            length = 0
+            for line in lines[1:]:
+                name, _, value = line.partition(b":")
+                if name.strip().lower() == b"content-length":
+                    length = int(value.strip())
+            end = head_end + 4 + length
+            if len(self.buffer) < end:
+                return statuses
+            parts = lines[0].split(b" ", 2)
+            statuses.append(int(parts[1]) if len(parts) > 1 and parts[1].isdigit() else 0)
+            self.buffer = self.buffer[end:]
+
+
+@dataclass
+class Stats:
+    latencies: list = field(default_factory=list)
+    statuses: Counter = field(default_factory=Counter)
+    requests: int = 0
+    errors: int = 0
+    unanswered: int = 0
+
+
+async def replay_connection(conn, args, start, stats, limit):
+    async def wait_until(captured):
+        if args.speed == 0:
+            return
+        delay = start + captured / args.speed - time.perf_counter()
+        if delay > 0:
+            await asyncio.sleep(delay)
+
+    stream = b"".join(chunk for _, chunk in conn.chunks)
+    ends = request_ends(stream)
+    stats.requests += len(ends)
+    # send time of every request, filled in once the chunk with its last byte is written
+    sent_at = [None] * len(ends)
+
+    await wait_until(conn.opened)
+    async with limit:
+        try:
+            reader, writer = await asyncio.open_connection(args.host, args.port or conn.port)
+        except OSError:
+            stats.errors += 1
+            stats.unanswered += len(ends)
+            return
+        writer.get_extra_info("socket").setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+        async def receive():
+            responses = ResponseReader()
+            answered = 0
+            while answered < len(ends):
+                data = await reader.read(65536)
+                if not data:
+                    break
+                now = time.perf_counter()
+                for status in responses.feed(data):
+                    stats.statuses[status] += 1
+                    if answered < len(ends) and sent_at[answered] is not None:
+                        stats.latencies.append(now - sent_at[answered])
+                    answered += 1
+            stats.unanswered += max(0, len(ends) - answered)
+
+        receiver = asyncio.create_task(receive())
+        try:
+            offset = 0
+            next_request = 0
+            for captured, chunk in conn.chunks:
+                await wait_until(captured)
+                writer.write(chunk)
+                await writer.drain()
+                offset += len(chunk)
+                now = time.perf_counter()
+                while next_request < len(ends) and ends[next_request] <= offset:
+                    sent_at[next_request] = now
+                    next_request += 1
+            if conn.closed is not None:
+                await wait_until(conn.closed)
+            await asyncio.wait_for(receiver, args.timeout)
+        except (OSError, asyncio.TimeoutError):
+            stats.errors += 1
+            receiver.cancel()
+        finally:
+            writer.close()
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0.0
+    index = min(len(sorted_values) - 1, int(round(p / 100 * (len(sorted_values) - 1))))
+    return sorted_values[index]
+
+
+async def replay(captured, args):
+    # a truncated connection has holes in its byte stream, replaying it would only measure misframed requests
+    connections = [c for c in captured if not c.truncated]
+    stats = Stats()
+    limit = asyncio.Semaphore(args.concurrency)
+    start = time.perf_counter()
+    # the capture clock starts with the server, shift it so the first connection opens right away
+    origin = start - connections[0].opened / args.speed if connections and args.speed else start
+    await asyncio.gather(*(replay_connection(c, args, origin, stats, limit) for c in connections))
+    elapsed = time.perf_counter() - start
+
+    latencies = sorted(stats.latencies)
+    report = {
+        "connections": len(connections),
+        "skipped_truncated": len(captured) - len(connections),
+        "requests": stats.requests,
+        "responses": sum(stats.statuses.values()),
+        "unanswered": stats.unanswered,
+        "errors": stats.errors,
+        "seconds": round(elapsed, 3),
+        "requests_per_second": round(len(latencies) / elapsed, 1) if elapsed > 0 else 0.0,
+        "latency_ms": {
+            name: round(percentile(latencies, p) * 1000, 3)
+            for name, p in (("p50", 50), ("p90", 90), ("p99", 99), ("p99.9", 99.9), ("max", 100))
+        },
+        "statuses": dict(sorted(stats.statuses.items())),
+    }
+    if args.json:
+        print(json.dumps(report))
+        return
+    print(f"connections  {report['connections']} replayed, {report['skipped_truncated']} truncated ones skipped")
+    print(f"requests     {report['requests']} sent, {report['responses']} answered, "
+          f"{report['unanswered']} unanswered, {report['errors']} connection errors")
+    print(f"duration     {report['seconds']} s")
+    print(f"throughput   {report['requests_per_second']} req/s")
+    print("latency ms   " + "  ".join(f"{k}={v}" for k, v in report["latency_ms"].items()))
+    print("statuses     " + "  ".join(f"{k}:{v}" for k, v in report["statuses"].items()))
+
+
+def dump(connections):
+    for c in connections:
+        closed = f"{c.closed:.6f}" if c.closed is not None else "-"
+        truncated = " truncated" if c.truncated else ""
+        print(f"connection {c.id} port {c.port} opened {c.opened:.6f} closed {closed}{truncated}")
+        for captured, chunk in c.chunks:
+            print(f"  {captured:.6f} {len(chunk):6d} bytes {chunk[:60]!r}")
+
+
+def parse_speed(value):
+    if value == "max":
+        return 0.0
+    if value == "original":
+        return 1.0
+    speed = float(value)
+    if speed <= 0:
+        raise argparse.ArgumentTypeError("speed has to be positive, 'original' or 'max'")
+    return speed
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("capture")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=0, help="send everything here instead of the captured ports")
+    parser.add_argument("--speed", type=parse_speed, default=1.0,
+                        help="'original' (default), a factor like 2 or 0.5, or 'max'")
+    parser.add_argument("--concurrency", type=int, default=1000, help="max connections open at once")
+    parser.add_argument("--timeout", type=float, default=10.0, help="seconds to wait for missing responses")
+    parser.add_argument("--json", action="store_true", help="print the report as one JSON line")
+    parser.add_argument("--dump", action="store_true", help="print the capture instead of replaying it")
+    args = parser.parse_args()
+
+    captured = load_capture(args.capture)
+    if args.dump:
+        dump(captured)
+    else:
+        asyncio.run(replay(captured, args))
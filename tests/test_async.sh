@@ -0,0 +1,12 @@
+#!/bin/zsh
+
+echo "Starting the async handler test: "
+echo "100 requests to /slow (200ms each) should finish in about 200ms, not 100 * 200ms / 4 workers"
+
+time (
+for i in {1..100}; do
+    curl -s -o /dev/null -w "%{http_code}\n" http://localhost:4222/slow &
+done
+wait
+)
+echo "Test complteted"
@@ -0,0 +1,16 @@
+#!/bin/zsh
+
+echo "Starting the h2c test: "
+echo "prior knowledge, Upgrade: h2c and 100 /slow streams that should share one connection"
+
+curl -s --http2-prior-knowledge -o /dev/null -w "prior knowledge: %{http_version} %{http_code}\n" http://localhost:4222/hello
+curl -s --http2 -o /dev/null -w "upgrade: %{http_version} %{http_code}\n" "http://localhost:4222/whoami?name=h2c"
+
+requests=()
+for i in {1..100}; do
+    requests+=(-o /dev/null http://localhost:4222/slow)
+done
+# --http2 rather than prior knowledge, curl 7.88 drops queued parallel transfers while the first prior knowledge connection starts
+# num_connects is 1 for the first transfer and 0 for every one multiplexed onto its connection
+time (curl -s --http2 --parallel --parallel-max 100 --no-progress-meter -w "%{http_code}/%{num_connects} " "${requests[@]}"; echo)
+echo "Test completed"
@@ -0,0 +1,20 @@
+#!/bin/zsh
+
+echo "Capture and replay test: "
+echo "start the server with HTTP_SERVER_CAPTURE=/tmp/traffic.cap HTTP_SERVER_NO_RATE_LIMIT=1, then run this script"
+echo "without HTTP_SERVER_NO_RATE_LIMIT the per-IP limiter answers most of the replayed connections with 429"
+
+for i in {1..50}; do
+    curl -s -o /dev/null http://localhost:4222/hello
+    curl -s -o /dev/null "http://localhost:4222/whoami?name=replay"
+done
+for i in {1..20}; do
+    curl -s -o /dev/null http://localhost:4222/slow &
+done
+wait
+
+echo "Replaying at original speed"
+python3 "${0:a:h}/replay.py" /tmp/traffic.cap
+echo "Replaying as fast as possible"
+python3 "${0:a:h}/replay.py" /tmp/traffic.cap --speed max
+echo "Test completed"